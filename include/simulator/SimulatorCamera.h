@@ -26,6 +26,7 @@
 #define SIMULATOR_CAMERA_H
 
 #include <ostream>
+#include <vector>
 
 #include <lima/HwInterface.h>
 #include <lima/HwBufferMgr.h>
@@ -100,6 +101,9 @@ public:
   void setFrameDim(const FrameDim &frame_dim);
   void getFrameDim(FrameDim &frame_dim);
 
+  void setPackedBits(int packed_bits);
+  void getPackedBits(int &packed_bits);
+
   void getMaxImageSize(Size &max_image_size) const;
   void getEffectiveImageSize(Size &effect_image_size) const;
 
@@ -168,6 +172,9 @@ private:
 
   TrigMode m_trig_mode;
 
+  int m_packed_bits = 0;                     //<! Bits per pixel of the packed frames, 0 if not packed
+  std::vector<unsigned char> m_packed_frame; //<! The current frame packed for fillData()
+
   SoftBufferCtrlObj m_buffer_ctrl_obj;
 
   Mode m_mode;                 //<! The current mode of the simulateur
@@ -0,0 +1,99 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#pragma once
+
+#if !defined(SIMULATOR_FILEREADER_H)
+#define SIMULATOR_FILEREADER_H
+
+#include <cstddef>
+#include <string>
+
+#include <simulator_export.h>
+
+namespace lima {
+
+namespace Simulator {
+
+/// A file read with positional reads (pread on POSIX).
+///
+/// A read needs no seek, so any number of threads may read the same file at
+/// once. A reader can be moved, but not copied. A file opened for direct
+/// reads bypasses the page cache (O_DIRECT on Linux, F_NOCACHE on macOS,
+/// FILE_FLAG_NO_BUFFERING on Windows).
+class SIMULATOR_EXPORT FileReader {
+public:
+  /// Alignment of the offsets, sizes and buffers of the direct reads
+  static const size_t direct_alignment = 4096;
+
+  FileReader();
+  explicit FileReader(const std::string &path, bool direct = false);
+  ~FileReader();
+
+  FileReader(FileReader &&o);
+  FileReader &operator=(FileReader &&o);
+
+  FileReader(const FileReader &) = delete;
+  FileReader &operator=(const FileReader &) = delete;
+
+  void open(const std::string &path, bool direct = false);
+  void close();
+
+  bool isOpen() const;
+  bool isDirect() const { return m_direct; }
+
+  unsigned long long size() const { return m_size; }
+
+  void read(unsigned long long offset, unsigned char *ptr, size_t size) const;
+
+private:
+#if defined(_WIN32)
+  void *m_handle; //<! The file HANDLE, INVALID_HANDLE_VALUE if closed
+#else
+  int m_fd;       //<! The file descriptor, -1 if closed
+#endif // _WIN32
+  unsigned long long m_size; //<! Size of the file in bytes
+  bool m_direct;             //<! The page cache is bypassed
+};
+
+/// A buffer aligned for the direct reads of a FileReader
+class SIMULATOR_EXPORT AlignedBuffer {
+public:
+  explicit AlignedBuffer(size_t size);
+  ~AlignedBuffer();
+
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+  unsigned char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  unsigned char *m_data;
+  size_t m_size;
+};
+
+} // namespace Simulator
+
+} // namespace lima
+
+#endif // !defined(SIMULATOR_FILEREADER_H)
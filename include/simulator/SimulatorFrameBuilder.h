@@ -25,6 +25,8 @@
 #if !defined(SIMULATOR_FRAMEBUILDER_H)
 #define SIMULATOR_FRAMEBUILDER_H
 
+#include <map>
+#include <memory>
 #include <vector>
 
 #include <lima/SizeUtils.h>
@@ -32,7 +34,9 @@
 
 #include <simulator_export.h>
 
+#include "simulator/SimulatorFrameCache.h"
 #include "simulator/SimulatorFrameGetter.h"
+#include "simulator/SimulatorFrameKernels.h"
 
 namespace lima {
 
@@ -48,6 +52,11 @@ struct SIMULATOR_EXPORT GaussPeak {
   GaussPeak(double x, double y, double w, double m) : x0(x), y0(y), fwhm(w), max(m) {}
 };
 
+/// A photon hitting a pixel of the frame
+struct SIMULATOR_EXPORT PhotonEvent {
+  int x, y; //<! The binned pixel
+};
+
 /// This class configures and generates frames for the Simulator
 class SIMULATOR_EXPORT FrameBuilder : public FrameGetter {
 
@@ -60,14 +69,25 @@ public:
     Gauss,
     Diffraction,
     Empty,
+    Photons, //<! Sparse photon counts of the Gauss peaks
   };
   enum RotationAxis {
     Static,
     RotationX,
     RotationY,
   };
+  enum BinningMode {
+    Sampled,    //<! Sums the sub-pixels of a bin
+    Integrated, //<! Integrates the peaks over the bin area, any bin factor
+  };
+  enum RenderMode {
+    Reference, //<! Evaluates every peak at every (sub-)pixel
+    Separable, //<! Sums outer products of per-peak 1-D profiles
+    Sprite,    //<! Separable, the profiles being interpolated from cached oversampled sprites
+  };
 
   typedef std::vector<struct GaussPeak> PeakList;
+  typedef std::vector<struct PhotonEvent> PhotonList;
 
   FrameBuilder();
   FrameBuilder(FrameDim &frame_dim, Bin &bin, Roi &roi, const PeakList &peaks, double grow_factor);
@@ -80,6 +100,9 @@ public:
 
   void getEffectiveFrameDim(FrameDim &dim) const;
 
+  void getImageType(ImageType &image_type) const;
+  void setImageType(ImageType image_type);
+
   void getBin(Bin &bin) const;
   void setBin(const Bin &bin);
   void checkBin(Bin &bin) const;
@@ -97,6 +120,40 @@ public:
   void getFillType(FillType &fill_type) const;
   void setFillType(FillType fill_type);
 
+  void getRenderMode(RenderMode &render_mode) const;
+  void setRenderMode(RenderMode render_mode);
+
+  void getBinningMode(BinningMode &binning_mode) const;
+  void setBinningMode(BinningMode binning_mode);
+
+  void getPeakCutoff(double &nb_sigma) const;
+  void setPeakCutoff(const double &nb_sigma);
+  void getPeakCutoffError(double &max_error) const;
+
+  void getInstructionSet(FrameKernels::InstructionSet &instruction_set) const;
+  void setInstructionSet(FrameKernels::InstructionSet instruction_set);
+
+  void getNbThreads(int &nb_threads) const;
+  void setNbThreads(int nb_threads);
+
+  void getPinThreads(bool &pin_threads) const;
+  void setPinThreads(bool pin_threads);
+
+  void getTileSize(int &width, int &height) const;
+  void setTileSize(int width, int height);
+
+  void getShotNoise(bool &shot_noise) const;
+  void setShotNoise(bool shot_noise);
+
+  void getReadNoise(double &sigma) const;
+  void setReadNoise(const double &sigma);
+
+  void getDarkOffset(double &offset) const;
+  void setDarkOffset(const double &offset);
+
+  void getNoiseSeed(unsigned int &seed) const;
+  void setNoiseSeed(unsigned int seed);
+
   void getRotationAxis(RotationAxis &rot_axis) const;
   void setRotationAxis(RotationAxis rot_axis);
 
@@ -115,20 +172,88 @@ public:
   void getDiffractionSpeed(double &sx, double &sy) const;
   void setDiffractionSpeed(const double &sx, const double &sy);
 
+  void getModuleLayout(Size &module_size, Size &gap_size, int &nb_modules_x, int &nb_modules_y) const;
+  void setModuleLayout(const Size &module_size, const Size &gap_size, int nb_modules_x, int nb_modules_y);
+
+  void getGapValue(double &value) const;
+  void setGapValue(const double &value);
+
+  void getModuleOrder(bool &module_order) const;
+  void setModuleOrder(bool module_order);
+
+  void getFrameCacheSize(int &size_mb) const;
+  void setFrameCacheSize(int size_mb);
+  void getFrameCacheHits(unsigned long &hits) const;
+  void getFrameCacheMisses(unsigned long &misses) const;
+
   bool getFrame(unsigned long frame_nr, unsigned char *ptr) override;
-  void prepareAcq() {}
+  void getPhotonEvents(unsigned long frame_nr, PhotonList &photons) const;
+  void prepareAcq();
 
-  /// Gets the maximum "hardware" image size
-  void getMaxImageSize(Size &max_size) const
-  { max_size = m_frame_dim.getSize(); }
+  void getMaxImageSize(Size &max_size) const;
 
 private:
+  /// A box of binned pixels, written with a row stride
+  struct FrameRegion {
+    int bx0, bxM;  //<! Binned columns [bx0, bxM)
+    int by0, byM;  //<! Binned rows [by0, byM)
+    size_t stride; //<! Pixels between two rows of the buffer
+  };
+
+  /// The binned box of pixels where a peak is evaluated, and its profiles
+  struct PeakFootprint {
+    int x_begin, x_end; //<! Binned columns [x_begin, x_end)
+    int y_begin, y_end; //<! Binned rows [y_begin, y_end)
+    size_t x_prof;      //<! Offset of the X profile
+    size_t y_prof;      //<! Offset of the Y profile
+  };
+
+  /// The peaks of a frame clipped to their footprints, with their profiles
+  struct PeakProfiles {
+    std::vector<PeakFootprint> footprints;
+    std::vector<double> x_prof; //<! X profiles, normalized to 1
+    std::vector<double> y_prof; //<! Y profiles, times the peak maximum and scale
+
+    /// Uniform grid of square cells over the binned frame, listing the
+    /// footprints overlapping each cell
+    int cell_size;                  //<! Side of a cell in binned pixels
+    int grid_x0, grid_y0;           //<! Binned coordinates of the first cell
+    int grid_width, grid_height;    //<! Number of cells
+    std::vector<size_t> cell_begin; //<! Footprints of cell c: cell_peaks[cell_begin[c], cell_begin[c + 1])
+    std::vector<int> cell_peaks;    //<! Indices in footprints, sorted by cell
+  };
+
+  /// Binned 1-D profiles of a peak shape for each sub-pixel phase of its center
+  struct PeakSprite {
+    int half;                   //<! Binned pixels [-half, half] around the center pixel
+    std::vector<double> phases; //<! (oversampling + 1) profiles of 2 * half + 1 pixels
+  };
+
+  /// The sprites of the peak shapes (FWHM) in X and in Y
+  struct PeakSprites {
+    std::map<double, PeakSprite> x, y;
+  };
+  typedef std::shared_ptr<const PeakSprites> Sprites;
+
+  /// Binned and RoI-cropped frame, shared with the frames being generated
+  typedef std::shared_ptr<const std::vector<double> > BaseFrame;
+
   FrameDim m_frame_dim; //<! Generated frame dimensions
   Bin m_bin;            //<! "Hardware" Bin
   Roi m_roi;            //<! "Hardware" RoI
   PeakList m_peaks;     //<! Peaks to put in each frame
   double m_grow_factor; //<! Peaks grow % with each frame
   FillType m_fill_type;
+  RenderMode m_render_mode;
+  BinningMode m_binning_mode;
+  double m_peak_cutoff; //<! Peak footprint half-size in sigmas (0 = whole frame)
+  FrameKernels::InstructionSet m_instruction_set;
+  const FrameKernels *m_kernels; //<! Row kernels for m_instruction_set
+  int m_nb_threads;              //<! Threads generating a frame (0 = OpenMP default)
+  bool m_pin_threads;            //<! Pin the generating threads to cores
+  int m_tile_width;              //<! Binned tile size of the Separable renderer
+  int m_tile_height;
+  FrameKernels::NoiseModel m_noise; //<! Noise added to the generated frames
   RotationAxis m_rot_axis;
   double m_rot_angle;
   double m_rot_speed;
@@ -138,16 +263,76 @@ private:
   double m_diffract_y;
   double m_diffract_sx;
   double m_diffract_sy;
+  BaseFrame m_base_frame;   //<! Cached frame before scaling (Diffraction pattern or still Gauss peaks)
+  Sprites m_sprites;        //<! Cached peak sprites of the Sprite render mode
+  FrameCache m_frame_cache; //<! Generated frames of periodic sequences
+
+  Size m_module_size;  //<! Size of a detector module
+  Size m_gap_size;     //<! Size of the gaps between the modules
+  int m_nb_modules_x;  //<! Number of modules in each direction
+  int m_nb_modules_y;
+  double m_gap_value;  //<! Value of the gap pixels
+  bool m_module_order; //<! Frames made of the modules one after the other, without gaps
+
+  typedef void (FrameBuilder::*FillFunction)(unsigned long frame_nr, const FrameRegion &region,
+                                             unsigned char *ptr) const;
+  FillFunction m_fill_function; //<! Specialized fill for the current settings, NULL if unsupported
+
+  typedef void (FrameBuilder::*GapsFunction)(unsigned char *ptr) const;
+  GapsFunction m_gaps_function; //<! fillGaps() for the current image type
 
   void init(FrameDim &frame_dim, Bin &bin, Roi &roi, const PeakList &peaks, double grow_factor);
 
   void checkValid(const FrameDim &frame_dim, const Bin &bin, const Roi &roi);
   void checkPeaks(PeakList const &peaks);
-  double dataXY(unsigned long frame_nr, const PeakList &peaks, int x, int y) const;
+  double dataGauss(const PeakList &peaks, double x, double y) const;
   double dataDiffract(double x, double y) const;
+  void selectFillFunction();
   template <class depth>
-  void fillData(unsigned long frame_nr, unsigned char *ptr) const;
-
+  void selectFillFunction();
+  template <class depth>
+  FillFunction getFillFunction() const;
+  template <class depth, FillType fill_type, int bin>
+  void fillReference(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const;
+  template <class depth>
+  void fillSeparable(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const;
+  template <class depth>
+  void fillDiffraction(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const;
+  template <class depth>
+  void fillScaled(const std::vector<double> &base, unsigned long frame_nr, double scale, const FrameRegion &region,
+                  unsigned char *ptr) const;
+  template <class depth>
+  void fillPhotons(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const;
+  void samplePhotons(unsigned long frame_nr, const FrameRegion &region, PhotonList &photons) const;
+  void fillModules(unsigned long frame_nr, unsigned char *ptr) const;
+  template <class depth>
+  void fillGaps(unsigned char *ptr) const;
+
+  void gaussProfile(double x0, double fwhm, int bin, int b0, int n, double *profile) const;
+  void buildSprite(double fwhm, int bin, PeakSprite &sprite) const;
+  void spriteProfile(const PeakSprite &sprite, double x0, int bin, int b0, int n, double *profile) const;
+  void buildSprites();
+  void invalidateSprites();
+  void diffractRow(int bx0, int by, int n, double *row) const;
+  bool hasNoise() const;
+  void noiseRow(unsigned long frame_nr, int bx0, int by, const double *src, double scale, double *dst, int n) const;
+  void getPeakProfiles(double rot_angle, double scale, const FrameRegion &region, PeakProfiles &profiles) const;
+  void buildPeakGrid(int bx0, int bxM, int by0, int byM, PeakProfiles &profiles) const;
+  bool gaussTile(const PeakProfiles &profiles, int tx0, int ty0, int width, int height, std::vector<int> &peaks,
+                 double *tile, size_t stride) const;
+  bool isBaseFrameStill() const;
+  void buildBaseFrame();
+  void invalidateBaseFrame();
+  void getFrameKey(unsigned long frame_nr, FrameCache::Key &key) const;
+  void getFrameRegion(FrameRegion &region) const;
+  bool hasModules() const;
+  bool isFrameRepeating() const;
+  void checkModuleLayout(const Size &module_size, const Size &gap_size, int nb_modules_x, int nb_modules_y,
+                         const Bin &bin) const;
+  int getNbWorkers() const;
+  void pinWorker() const;
+  void getBinnedRange(int &bx0, int &bxM, int &by0, int &byM) const;
+  bool getPeakFootprint(const GaussPeak &peak, int bx0, int bxM, int by0, int byM, PeakFootprint &fp) const;
   PeakList getGaussPeaksFrom3d(double angle) const;
   static double gauss2D(double x, double y, double x0, double y0, double fwhm, double max);
 };
@@ -0,0 +1,94 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#pragma once
+
+#if !defined(SIMULATOR_FRAMECACHE_H)
+#define SIMULATOR_FRAMECACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <simulator_export.h>
+
+namespace lima {
+
+namespace Simulator {
+
+/// A least recently used cache of generated frames, bounded in memory.
+///
+/// The frames are keyed on the parameters that change from one frame to the
+/// next, the owner clears the cache when any other parameter changes. All the
+/// methods are thread-safe, the frames being copied outside the lock. A copy
+/// of the cache gets the same memory budget, but no frame.
+class SIMULATOR_EXPORT FrameCache {
+public:
+  /// The per-frame parameters a frame only depends on
+  struct Key {
+    double rot_angle;  //<! Rotation angle of the peaks, in [0, 360)
+    double diffract_x; //<! Position of the Diffraction source
+    double diffract_y;
+    double scale;      //<! Frame scale (grow factor)
+    int width, height; //<! Effective frame geometry
+    int image_type;
+
+    bool operator<(const Key &o) const;
+  };
+
+  FrameCache();
+
+  FrameCache(const FrameCache &o);
+  FrameCache &operator=(const FrameCache &o);
+
+  void getMaxSize(size_t &max_size) const;
+  void setMaxSize(size_t max_size);
+
+  void getStats(unsigned long &hits, unsigned long &misses) const;
+  void resetStats();
+
+  bool get(const Key &key, unsigned char *ptr, size_t size);
+  void put(const Key &key, const unsigned char *ptr, size_t size);
+  void clear();
+
+private:
+  typedef std::shared_ptr<const std::vector<unsigned char>> Frame;
+  typedef std::list<std::pair<Key, Frame>> FrameList;
+
+  void evict(size_t max_size);
+
+  mutable std::mutex m_mutex;
+  size_t m_max_size;                           //<! Memory budget in bytes, 0 disables the cache
+  size_t m_size;                               //<! Bytes of the cached frames
+  FrameList m_frames;                          //<! The most recently used first
+  std::map<Key, FrameList::iterator> m_index; //<! The frames by key
+  unsigned long m_hits, m_misses;
+};
+
+} // namespace Simulator
+
+} // namespace lima
+
+#endif // !defined(SIMULATOR_FRAMECACHE_H)
@@ -23,6 +23,8 @@
 #if !defined(SIMULATOR_FRAMEGETTER_H)
 #define SIMULATOR_FRAMEGETTER_H
 
+#include <cstddef>
+
 #include <lima/SizeUtils.h>
 #include <lima/HwMaxImageSizeCallback.h>
 
@@ -38,6 +40,14 @@ class Exception;
 
 namespace Simulator {
 
+/// Returns the size in bytes of a frame. Unlike FrameDim::getMemSize(), which
+/// returns an int, it does not overflow for frames larger than 2 GiB.
+inline size_t getFrameMemSize(const FrameDim &frame_dim)
+{
+  const Size &size = frame_dim.getSize();
+  return size_t(size.getWidth()) * size.getHeight() * frame_dim.getDepth();
+}
+
 /// This interface describes a way to get the next frame buffer
 struct SIMULATOR_EXPORT FrameGetter : public HwMaxImageSizeCallbackGen {
   virtual ~FrameGetter() {}
@@ -0,0 +1,128 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#pragma once
+
+#if !defined(SIMULATOR_FRAMEKERNELS_H)
+#define SIMULATOR_FRAMEKERNELS_H
+
+#include <simulator_export.h>
+
+namespace lima {
+
+namespace Simulator {
+
+/// The row kernels used by the FrameBuilder, compiled for several instruction sets.
+///
+/// The Scalar kernels use the libm exp(), log() and cos(). The vectorized kernels
+/// use polynomial approximations instead, with a relative error below 2e-14 for
+/// exp(x), x <= 0, and log(x), 0 < x < 1, and an absolute error below 1e-14 for
+/// cos(x), |x| < 1e6, which keeps the noise-free frames within 1 LSB of the
+/// Scalar ones.
+struct SIMULATOR_EXPORT FrameKernels {
+  enum InstructionSet {
+    Scalar,
+    SSE4,
+    AVX2,
+    AVX512,
+  };
+
+  /// Parameters of noise_row()
+  struct NoiseModel {
+    unsigned int seed;  //<! Key of the random number generator
+    bool shot_noise;    //<! Poisson noise, the signal being a number of photons
+    double read_noise;  //<! Standard deviation of the Gaussian read noise
+    double dark_offset; //<! Constant added to every pixel
+  };
+
+  /// Keys of the independent random streams of random_row()
+  enum RandomStream {
+    NOISE_STREAM  = 0x5A4E4F49, //<! Noise of the pixels
+    PEAK_STREAM   = 0x4B414550, //<! Number of photons of each peak
+    PHOTON_STREAM = 0x544F4850, //<! Positions of the photons
+  };
+
+  InstructionSet instruction_set;
+
+  /// profile[i] = sum(exp(-(x - x0)^2 * k)) for the bin sub-pixels x of pixel b0 + i
+  void (*gauss_profile)(double x0, double k, int bin, int b0, int n, double *profile);
+
+  /// row[i] += a * x[i]
+  void (*axpy)(double a, const double *x, double *row, int n);
+
+  /// profile[i] = integral of exp(-(x - x0)^2 / (2 sigma^2)) over the bin sub-pixels of pixel b0 + i
+  void (*gauss_integral)(double x0, double sigma, int bin, int b0, int n, double *profile);
+
+  /// row[i] += diffraction pattern at (x + i * dx, y), relative to the pattern center
+  void (*diffract_row)(double x, double dx, double y, int n, double *row);
+
+  /// dst[i] = src[i] * scale with noise. The random numbers only depend on
+  /// (seed, frame_nr, pixel0 + i), src and dst may be the same row
+  void (*noise_row)(const NoiseModel &noise, unsigned long frame_nr, unsigned long long pixel0, const double *src,
+                    double scale, double *dst, int n);
+
+  /// u[i] in (0, 1), z1[i] and z2[i] standard normal deviates. They only depend on
+  /// (seed, stream, frame_nr, counter0 + i), noise_row() using the NOISE_STREAM
+  void (*random_row)(unsigned int seed, unsigned int stream, unsigned long frame_nr, unsigned long long counter0,
+                     double *u, double *z1, double *z2, int n);
+
+  /// k[i] = Poisson deviate of mean lambda[i], from the deviates u[i] and z1[i] of random_row():
+  /// exact below a mean of 32, the rounded normal approximation above, as the shot noise of noise_row()
+  void (*poisson_row)(const double *lambda, const double *u, const double *z, double *k, int n);
+
+  /// dst[i] = src[i] * scale, saturated to the destination type
+  void (*store_u8)(const double *src, double scale, unsigned char *dst, int n);
+  void (*store_u16)(const double *src, double scale, unsigned short *dst, int n);
+  void (*store_u32)(const double *src, double scale, unsigned int *dst, int n);
+  void (*store_u64)(const double *src, double scale, unsigned long long *dst, int n);
+  void (*store_s8)(const double *src, double scale, signed char *dst, int n);
+  void (*store_s16)(const double *src, double scale, short *dst, int n);
+  void (*store_s32)(const double *src, double scale, int *dst, int n);
+  void (*store_s64)(const double *src, double scale, long long *dst, int n);
+
+  /// dst[i] = src[i] * scale, rounded to the nearest float and saturated to +/-FLT_MAX
+  void (*store_f32)(const double *src, double scale, float *dst, int n);
+
+  /// dst[i] = src[i] * scale, saturated to [lo, hi] (the range of an n-bit image type) in a 16 or
+  /// 32-bit word, two's complement
+  void (*store_n16)(const double *src, double scale, double lo, double hi, unsigned short *dst, int n);
+  void (*store_n32)(const double *src, double scale, double lo, double hi, unsigned int *dst, int n);
+
+  /// Packs n pixels, saturated to 10, 12, 14 or 24 bits, LSB first into (n * bits + 7) / 8 bytes
+  /// (as the Mono10p, Mono12p and Mono14p GenICam formats), src and dst must not overlap
+  void (*pack_10)(const unsigned short *src, unsigned char *dst, int n);
+  void (*pack_12)(const unsigned short *src, unsigned char *dst, int n);
+  void (*pack_14)(const unsigned short *src, unsigned char *dst, int n);
+  void (*pack_24)(const unsigned int *src, unsigned char *dst, int n);
+
+  /// Returns the kernels for the given instruction set
+  static const FrameKernels &get(InstructionSet instruction_set);
+
+  /// Returns the best instruction set supported by both the build and the CPU
+  static InstructionSet getCpuInstructionSet();
+};
+
+} // namespace Simulator
+
+} // namespace lima
+
+#endif // !defined(SIMULATOR_FRAMEKERNELS_H)
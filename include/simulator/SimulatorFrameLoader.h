@@ -25,16 +25,25 @@
 #if !defined(SIMULATOR_FRAMELOADER_H)
 #define SIMULATOR_FRAMELOADER_H
 
-#include <string>
-#include <fstream>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <lima/Debug.h>
 #include <lima/HwInterface.h>
 
 #include <simulator_export.h>
 
+#include <simulator/SimulatorFileReader.h>
 #include <simulator/SimulatorFrameGetter.h>
+#include <simulator/SimulatorHdf5File.h>
+#include <simulator/SimulatorMappedFile.h>
 
 namespace lima {
 
@@ -44,15 +53,44 @@ class SIMULATOR_EXPORT FrameLoader : public FrameGetter {
   DEB_CLASS_NAMESPC(DebModCamera, "FrameLoader", "Simulator");
 
 public:
-  static const bool is_thread_safe = false;
+  static const bool is_thread_safe = true;
+
+  /// How the frames are read from the files
+  enum ReadMode {
+    Streamed, //<! Read with positional reads
+    Mapped,   //<! Copied from a memory mapping of the files
+    Direct,   //<! Read bypassing the page cache, through aligned staging buffers
+  };
+
+  FrameLoader();
+  ~FrameLoader();
 
-  FrameLoader() : m_current_stream(std::make_shared<std::ifstream>()) {}
-  
   Camera::Mode getMode() const { return Camera::MODE_LOADER; }
 
   void setFilePattern(const std::string &file_pattern);
   void getFilePattern(std::string &file_pattern) const { file_pattern = m_file_pattern; }
 
+  void setDatasetPath(const std::string &dataset_path);
+  void getDatasetPath(std::string &dataset_path) const { dataset_path = m_dataset_path; }
+
+  void setRawFrameDim(const FrameDim &frame_dim);
+  void getRawFrameDim(FrameDim &frame_dim) const { frame_dim = m_raw_frame_dim; }
+
+  void setIndexFile(const std::string &index_file);
+  void getIndexFile(std::string &index_file) const { index_file = m_index_file; }
+
+  void getNbFrames(unsigned long &nb_frames) const;
+
+  void setReadMode(ReadMode read_mode);
+  void getReadMode(ReadMode &read_mode) const { read_mode = m_read_mode; }
+
+  void setReadAheadDepth(unsigned int nb_frames);
+  void getReadAheadDepth(unsigned int &nb_frames) const { nb_frames = m_read_ahead_depth; }
+
+  void getReadAheadLevel(unsigned int &nb_frames) const;
+  void getReadAheadStalls(unsigned long &nb_stalls) const;
+  void getReadAheadRate(double &bytes_per_sec) const;
+
   bool getFrame(unsigned long frame_nr, unsigned char *ptr) override;
   void prepareAcq();
 
@@ -68,12 +106,48 @@ public:
 
 private:
   typedef std::vector<std::string> files_t;
-    
+  typedef std::vector<std::pair<unsigned int, unsigned long long>> index_t;
+  typedef std::unique_ptr<unsigned char[]> buffer_t;
+
+  std::shared_ptr<const FileReader> getFileReader(unsigned int file_nr) const;
+  void readFrame(unsigned long frame_nr, unsigned char *ptr) const;
+  void readDirect(const FileReader &file_reader, unsigned long long offset, unsigned char *ptr, size_t size) const;
+
+  void startReader();
+  void stopReader();
+  void readAhead();
+  void getReadAheadFrame(unsigned long frame_nr, unsigned char *ptr);
+
   std::string m_file_pattern;                //<! The file pattern used to load the frames
   files_t m_files;                           //<! The filenames that matches the pattern above
-  files_t::const_iterator m_it_current_file; //<! An iterator to the filename that is currently read
-
-  std::shared_ptr<std::ifstream> m_current_stream; //<! The current stream
+  std::string m_dataset_path;                //<! The path of the frames in the HDF5 files
+  FrameDim m_raw_frame_dim;                  //<! The dimensions of the frames of the raw files
+  std::string m_index_file;                  //<! The file the index is persisted to, if any
+  index_t m_index;                           //<! The file number and data offset of every frame
+  std::vector<std::unique_ptr<Hdf5File>> m_hdf5_files; //<! The HDF5 datasets read through the library, by file number
+
+  ReadMode m_read_mode;
+  mutable std::mutex m_file_readers_mutex;
+  mutable std::vector<std::shared_ptr<const FileReader>> m_file_readers; //<! The open files, by file number
+  mutable std::deque<unsigned int> m_open_files;                         //<! The open files, the oldest first
+  std::vector<MappedFile> m_mapped_files; //<! The files mapped by prepareAcq, in the Mapped mode
+  mutable std::mutex m_staging_mutex;
+  mutable std::vector<std::unique_ptr<AlignedBuffer>> m_staging_buffers; //<! The free buffers of the Direct mode
+
+  unsigned int m_read_ahead_depth; //<! Size of the ring of pre-read frames, 0 reads synchronously
+  std::vector<buffer_t> m_ring;    //<! The pre-read frames, frame_nr modulo the depth
+  std::thread m_reader;            //<! The thread filling the ring
+  std::mutex m_ring_get_mutex;     //<! Serializes the getFrame() calls reading from the ring
+  mutable std::mutex m_ring_mutex;
+  std::condition_variable m_ring_cond;
+  unsigned long m_ring_first;      //<! The next frame expected by getFrame()
+  unsigned long m_ring_ready;      //<! The frames [first, ready) are in the ring
+  bool m_reader_busy;              //<! The reader is filling the slot of frame ready
+  bool m_reader_stop;
+  std::string m_reader_error;      //<! Why the reader failed to read frame ready
+  unsigned long m_nb_stalls;       //<! Number of getFrame() calls that waited for the reader
+  unsigned long long m_bytes_read; //<! Bytes read ahead since prepareAcq()
+  std::chrono::steady_clock::time_point m_read_start, m_read_end;
 
   FrameDim m_frame_dim;
 };
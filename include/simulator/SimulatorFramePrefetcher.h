@@ -30,6 +30,7 @@
 
 #include <memory>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include <lima/SizeUtils.h>
@@ -52,7 +53,7 @@ class FramePrefetcher : public FrameGetterImpl {
   typedef std::unique_ptr<unsigned char[]> buffer_t;
 
 public:
-  FramePrefetcher() {}
+  FramePrefetcher() : m_mem_size(0) {}
 
   FramePrefetcher(const FramePrefetcher &) = delete;
   FramePrefetcher & operator=(const FramePrefetcher &) = delete;
@@ -84,7 +85,7 @@ public:
       FrameGetterImpl::getEffectiveFrameDim(frame_dim);
 
       // Allocate the buffers for the prebuilt frames
-      m_mem_size = frame_dim.getMemSize();
+      m_mem_size = getFrameMemSize(frame_dim);
       for (buffer_t& frame_buffer : m_prefetched_frame_buffers) {
         //In C++14, use std::make_unique<unsigned char[]>(m_mem_size);
         frame_buffer = std::unique_ptr<unsigned char[]>(new unsigned char[m_mem_size]);
@@ -97,10 +98,22 @@ public:
       }
 
       if (FrameGetterImpl::is_thread_safe) {
+        // An exception must not escape the parallel region
+        std::vector<std::string> errors(m_prefetched_frame_buffers.size());
+
 // Parallel for loop
 #pragma omp parallel for
-        for (int i = 0; i < m_prefetched_frame_buffers.size(); i++)
-          FrameGetterImpl::getFrame(i, m_prefetched_frame_buffers[i].get());
+        for (long i = 0; i < long(m_prefetched_frame_buffers.size()); i++) {
+          try {
+            FrameGetterImpl::getFrame(i, m_prefetched_frame_buffers[i].get());
+          } catch (Exception &e) {
+            errors[i] = e.getErrMsg();
+          }
+        }
+
+        for (const std::string &error : errors)
+          if (!error.empty())
+            throw LIMA_EXC(CameraPlugin, Error, error);
       } else
         // Serial for loop
         for (size_t i = 0; i < m_prefetched_frame_buffers.size(); i++)
@@ -123,7 +136,7 @@ public:
 
 private:
   std::vector<buffer_t> m_prefetched_frame_buffers;   //<! A vector of frame buffers
-  int m_mem_size;                                     //<! The size of a mem buffer
+  size_t m_mem_size;                                  //<! The size of a mem buffer
 };
 
 } // namespace Simulator
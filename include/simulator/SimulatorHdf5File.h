@@ -0,0 +1,89 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#pragma once
+
+#if !defined(SIMULATOR_HDF5FILE_H)
+#define SIMULATOR_HDF5FILE_H
+
+#include <cstdint>
+#include <string>
+
+#include <lima/SizeUtils.h>
+
+#include <simulator_export.h>
+
+namespace lima {
+
+namespace Simulator {
+
+/// A dataset of frames in an HDF5 (or NeXus) file.
+///
+/// The dataset holds a single frame (height, width) or a stack of frames
+/// (nb_frames, height, width). The frames stored as is, in a contiguous
+/// dataset or in uncompressed chunks of one frame, can be read straight from
+/// the file at the offset given by getFrameOffset(), bypassing the library.
+/// The other frames are read through the HDF5 library (and its filters), the
+/// calls being serialized as the library may not be thread-safe.
+class SIMULATOR_EXPORT Hdf5File {
+public:
+  Hdf5File();
+  Hdf5File(const std::string &path, const std::string &dataset);
+  ~Hdf5File();
+
+  Hdf5File(const Hdf5File &) = delete;
+  Hdf5File &operator=(const Hdf5File &) = delete;
+
+  void open(const std::string &path, const std::string &dataset);
+  void close();
+
+  bool isOpen() const { return m_dataset >= 0; }
+
+  void getFrameDim(FrameDim &frame_dim) const { frame_dim = m_frame_dim; }
+  void getNbFrames(unsigned long &nb_frames) const { nb_frames = m_nb_frames; }
+
+  bool getFrameOffset(unsigned long frame_nr, unsigned long long &offset) const;
+  void readFrame(unsigned long frame_nr, unsigned char *ptr) const;
+
+private:
+  /// Where the frames stored as is are found
+  enum Layout {
+    Encoded,    //<! Nowhere, the frames are read through the library
+    Contiguous, //<! One after the other, from the dataset offset
+    Chunked,    //<! One per chunk
+  };
+
+  std::int64_t m_file;     //<! The hid_t of the file, -1 if closed
+  std::int64_t m_dataset;  //<! The hid_t of the dataset, -1 if closed
+  std::int64_t m_mem_type; //<! The hid_t of the native type of the pixels
+  int m_rank;
+  Layout m_layout;
+  unsigned long long m_offset; //<! Offset of a Contiguous dataset in the file
+  unsigned long m_nb_frames;
+  FrameDim m_frame_dim;
+};
+
+} // namespace Simulator
+
+} // namespace lima
+
+#endif // !defined(SIMULATOR_HDF5FILE_H)
@@ -0,0 +1,80 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#pragma once
+
+#if !defined(SIMULATOR_MAPPEDFILE_H)
+#define SIMULATOR_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <simulator_export.h>
+
+namespace lima {
+
+namespace Simulator {
+
+/// A read-only memory mapping of a whole file.
+///
+/// The file descriptor is closed as soon as the file is mapped, so any number
+/// of files can stay mapped. A mapping can be moved, but not copied.
+class SIMULATOR_EXPORT MappedFile {
+public:
+  /// The access pattern hints given to the kernel
+  enum Advice {
+    Normal,     //<! No particular access pattern
+    Sequential, //<! The pages are read once, in order
+    WillNeed,   //<! The pages are read soon, start reading them ahead
+  };
+
+  MappedFile();
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(MappedFile &&o);
+  MappedFile &operator=(MappedFile &&o);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  void open(const std::string &path);
+  void close();
+
+  bool isOpen() const { return m_is_open; }
+
+  const unsigned char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+  void advise(Advice advice, size_t offset = 0, size_t length = size_t(-1)) const;
+
+private:
+  const unsigned char *m_data; //<! The mapping, null for an empty file
+  size_t m_size;               //<! Size of the file in bytes
+  bool m_is_open;
+};
+
+} // namespace Simulator
+
+} // namespace lima
+
+#endif // !defined(SIMULATOR_MAPPEDFILE_H)
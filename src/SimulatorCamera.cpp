@@ -26,10 +26,14 @@
 #include <processlib/win/unistd.h>
 #endif
 
+#include <algorithm>
+#include <climits>
+
 #include <lima/Debug.h>
 
 #include "simulator/SimulatorCamera.h"
 #include "simulator/SimulatorFrameGetter.h"
+#include "simulator/SimulatorFrameKernels.h"
 #include "simulator/SimulatorFrameBuilder.h"
 #include "simulator/SimulatorFrameLoader.h"
 #include "simulator/SimulatorFramePrefetcher.h"
@@ -37,6 +41,82 @@
 using namespace lima;
 using namespace lima::Simulator;
 
+/**
+ * @brief Checks that the pixels of the image type fit in the packed
+ *bits, without sign
+ *
+ * @exception lima::Exception  The image type cannot be packed
+ *******************************************************************/
+static void checkPackable(int packed_bits, ImageType image_type)
+{
+  switch (image_type) {
+  case Bpp10:
+  case Bpp12:
+  case Bpp14:
+  case Bpp16:
+    if (packed_bits != 24)
+      return;
+    break;
+  case Bpp24:
+  case Bpp32:
+    if (packed_bits == 24)
+      return;
+    break;
+  default:
+    break;
+  }
+  throw LIMA_HW_EXC(InvalidValue, "Image type cannot be packed: 10, 12 or 14 bits need 16-bit unsigned pixels, 24 bits need 32-bit unsigned integer pixels");
+}
+
+/**
+ * @brief Returns the size in bytes of a packed frame
+ *******************************************************************/
+static size_t getPackedSize(int packed_bits, const FrameDim &frame_dim)
+{
+  size_t nb_pixels = size_t(frame_dim.getSize().getWidth()) * frame_dim.getSize().getHeight();
+  return (nb_pixels * packed_bits + 7) / 8;
+}
+
+/**
+ * @brief Packs the pixels of a frame, LSB first
+ *
+ * The pixels are packed by chunks, the kernels taking an int
+ *number of pixels.
+ *******************************************************************/
+template <class T>
+static void packFrame(void (*pack)(const T *, unsigned char *, int), int packed_bits, const unsigned char *src,
+                      unsigned char *dst, size_t nb_pixels)
+{
+  // A multiple of 8 pixels, so that each chunk fills whole bytes
+  const size_t chunk_size = size_t(1) << 20;
+
+  const T *pixels = reinterpret_cast<const T *>(src);
+  for (size_t i = 0; i < nb_pixels; i += chunk_size) {
+    size_t n = std::min(chunk_size, nb_pixels - i);
+    pack(pixels + i, dst, int(n));
+    dst += n * packed_bits / 8;
+  }
+}
+
+static void packFrame(int packed_bits, const unsigned char *src, unsigned char *dst, size_t nb_pixels)
+{
+  const FrameKernels &kernels = FrameKernels::get(FrameKernels::getCpuInstructionSet());
+  switch (packed_bits) {
+  case 10:
+    packFrame(kernels.pack_10, packed_bits, src, dst, nb_pixels);
+    break;
+  case 12:
+    packFrame(kernels.pack_12, packed_bits, src, dst, nb_pixels);
+    break;
+  case 14:
+    packFrame(kernels.pack_14, packed_bits, src, dst, nb_pixels);
+    break;
+  default:
+    packFrame(kernels.pack_24, packed_bits, src, dst, nb_pixels);
+    break;
+  }
+}
+
 Camera::SimuThread::SimuThread(Camera &simu) : m_simu(&simu)
 {
   DEB_CONSTRUCTOR();
@@ -98,6 +178,18 @@ void Camera::SimuThread::execPrepareAcq()
     // Delegate to the frame getter that may need some preparation
     m_simu->m_frame_getter->prepareAcq();
 
+    if (m_simu->m_packed_bits) {
+      FrameDim frame_dim;
+      m_simu->m_frame_getter->getEffectiveFrameDim(frame_dim);
+      checkPackable(m_simu->m_packed_bits, frame_dim.getImageType());
+
+      // The size of the packed Data is an int
+      size_t packed_size = getPackedSize(m_simu->m_packed_bits, frame_dim);
+      if (packed_size > size_t(INT_MAX))
+        throw LIMA_HW_EXC(InvalidValue, "Packed frame larger than 2 GiB");
+      m_simu->m_packed_frame.resize(packed_size);
+    }
+
     setStatus(Prepare);
   } catch (Exception &e) {
     DEB_ERROR() << e;
@@ -127,17 +219,22 @@ Data::TYPE dataTypeFromImageType(int imageType)
 	  return Data::UINT64;
     case ImageType::Bpp64S:
 	  return Data::INT64;
-    case ImageType::Bpp1:
-    case ImageType::Bpp4:
-    case ImageType::Bpp6:
+    // The n-bit types are stored in 16 or 32-bit words
     case ImageType::Bpp10:
-    case ImageType::Bpp10S:
     case ImageType::Bpp12:
-    case ImageType::Bpp12S:
     case ImageType::Bpp14:
+	  return Data::UINT16;
+    case ImageType::Bpp10S:
+    case ImageType::Bpp12S:
     case ImageType::Bpp14S:
+	  return Data::INT16;
     case ImageType::Bpp24:
+	  return Data::UINT32;
     case ImageType::Bpp24S:
+	  return Data::INT32;
+    case ImageType::Bpp1:
+    case ImageType::Bpp4:
+    case ImageType::Bpp6:
       throw LIMA_HW_EXC(InvalidValue, "ImageType unsupported in the simulator");
     default:
       throw LIMA_HW_EXC(InvalidValue, "ImageType unknown");
@@ -212,8 +309,20 @@ void Camera::SimuThread::_exposure()
         buffer.data      = ptr;
         buffer.owner     = Buffer::MAPPED;
         data.frameNumber = frame_nb;
-        data.type        = dataTypeFromImageType(frame_dim.getImageType());
-        data.dimensions  = {frame_dim.getSize().getWidth(), frame_dim.getSize().getHeight()};
+        if (m_simu->m_packed_bits) {
+          // The packed frame is a stream of bytes, the frame buffer is left unpacked
+          std::vector<unsigned char> &packed_frame = m_simu->m_packed_frame;
+          size_t nb_pixels = size_t(frame_dim.getSize().getWidth()) * frame_dim.getSize().getHeight();
+          if (getPackedSize(m_simu->m_packed_bits, frame_dim) != packed_frame.size())
+            throw LIMA_HW_EXC(Error, "Packed frame size changed since prepareAcq");
+          packFrame(m_simu->m_packed_bits, ptr, packed_frame.data(), nb_pixels);
+          buffer.data     = packed_frame.data();
+          data.type       = Data::UINT8;
+          data.dimensions = {int(packed_frame.size())};
+        } else {
+          data.type       = dataTypeFromImageType(frame_dim.getImageType());
+          data.dimensions = {frame_dim.getSize().getWidth(), frame_dim.getSize().getHeight()};
+        }
         data.setBuffer(&buffer);
         m_simu->fillData(data);
         data.releaseBuffer();
@@ -340,6 +449,47 @@ void Camera::getFrameDim(FrameDim &frame_dim)
   m_frame_getter->getFrameDim(frame_dim);
 }
 
+/**
+ * @brief Sets the bit packing of the frames passed to fillData()
+ *
+ * The pixels are packed LSB first, without padding between rows (as
+ *the Mono10p, Mono12p and Mono14p GenICam formats), and passed as a
+ *1D UINT8 Data. 10, 12 and 14 bits need a 16-bit unsigned image
+ *type, 24 bits a 32-bit unsigned integer one, which is checked by
+ *prepareAcq(). The pixels are saturated to the packed bits. The
+ *frames are packed into a buffer of the Camera, of at most 2 GiB,
+ *the frame buffers keeping the unpacked pixels.
+ *
+ * @param[in] packed_bits  int 10, 12, 14 or 24, 0 to not pack
+ *******************************************************************/
+void Camera::setPackedBits(int packed_bits)
+{
+  DEB_MEMBER_FUNCT();
+
+  switch (packed_bits) {
+  case 0:
+  case 10:
+  case 12:
+  case 14:
+  case 24:
+    break;
+  default:
+    throw LIMA_HW_EXC(InvalidValue, "Invalid packed bits");
+  }
+
+  m_packed_bits = packed_bits;
+}
+
+/**
+ * @brief Gets the bit packing of the frames
+ *
+ * @param[out] packed_bits  int 10, 12, 14 or 24, 0 if not packed
+ *******************************************************************/
+void Camera::getPackedBits(int &packed_bits)
+{
+  packed_bits = m_packed_bits;
+}
+
 void Camera::setHwMaxImageSizeCallback(HwMaxImageSizeCallback *cbk)
 {
   DEB_MEMBER_FUNCT();
@@ -0,0 +1,260 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "lima/Exceptions.h"
+
+#include "simulator/SimulatorFileReader.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+using namespace std;
+
+#if defined(_WIN32)
+FileReader::FileReader() : m_handle(INVALID_HANDLE_VALUE), m_size(0), m_direct(false) {}
+
+FileReader::FileReader(const string &path, bool direct) : m_handle(INVALID_HANDLE_VALUE), m_size(0), m_direct(false)
+{
+  open(path, direct);
+}
+
+FileReader::FileReader(FileReader &&o) : m_handle(o.m_handle), m_size(o.m_size), m_direct(o.m_direct)
+{
+  o.m_handle = INVALID_HANDLE_VALUE;
+  o.m_size   = 0;
+  o.m_direct = false;
+}
+
+FileReader &FileReader::operator=(FileReader &&o)
+{
+  if (this != &o) {
+    close();
+    swap(m_handle, o.m_handle);
+    swap(m_size, o.m_size);
+    swap(m_direct, o.m_direct);
+  }
+  return *this;
+}
+
+bool FileReader::isOpen() const
+{
+  return m_handle != INVALID_HANDLE_VALUE;
+}
+#else
+FileReader::FileReader() : m_fd(-1), m_size(0), m_direct(false) {}
+
+FileReader::FileReader(const string &path, bool direct) : m_fd(-1), m_size(0), m_direct(false)
+{
+  open(path, direct);
+}
+
+FileReader::FileReader(FileReader &&o) : m_fd(o.m_fd), m_size(o.m_size), m_direct(o.m_direct)
+{
+  o.m_fd     = -1;
+  o.m_size   = 0;
+  o.m_direct = false;
+}
+
+FileReader &FileReader::operator=(FileReader &&o)
+{
+  if (this != &o) {
+    close();
+    swap(m_fd, o.m_fd);
+    swap(m_size, o.m_size);
+    swap(m_direct, o.m_direct);
+  }
+  return *this;
+}
+
+bool FileReader::isOpen() const
+{
+  return m_fd >= 0;
+}
+#endif // _WIN32
+
+FileReader::~FileReader()
+{
+  close();
+}
+
+/**
+ * @brief Opens a file for reading, closing the previous one
+ *
+ * @param[in] path    std::string the file name
+ * @param[in] direct  bool bypass the page cache, the reads must
+ *then be aligned on direct_alignment. The file is read through the
+ *page cache if its file system does not support it, see isDirect()
+ *******************************************************************/
+void FileReader::open(const string &path, bool direct)
+{
+  close();
+
+  ostringstream msg;
+  msg << "Failed to open file " << path << ": ";
+
+#if defined(_WIN32)
+  HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              direct ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    msg << "error " << GetLastError();
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size)) {
+    msg << "error " << GetLastError();
+    CloseHandle(handle);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  m_handle = handle;
+  m_size   = (unsigned long long) size.QuadPart;
+  m_direct = direct;
+#else
+#if defined(O_DIRECT)
+  int fd = ::open(path.c_str(), O_RDONLY | (direct ? O_DIRECT : 0));
+  // Some file systems (tmpfs) do not support direct reads
+  if ((fd < 0) && direct && (errno == EINVAL)) {
+    direct = false;
+    fd     = ::open(path.c_str(), O_RDONLY);
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+#if defined(F_NOCACHE)
+  if ((fd >= 0) && direct)
+    fcntl(fd, F_NOCACHE, 1);
+#endif
+#endif // O_DIRECT
+  if (fd < 0) {
+    msg << strerror(errno);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    msg << strerror(errno);
+    ::close(fd);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  m_fd     = fd;
+  m_size   = (unsigned long long) st.st_size;
+  m_direct = direct;
+#endif // _WIN32
+}
+
+/**
+ * @brief Closes the file, if any
+ *******************************************************************/
+void FileReader::close()
+{
+#if defined(_WIN32)
+  if (m_handle != INVALID_HANDLE_VALUE)
+    CloseHandle(m_handle);
+  m_handle = INVALID_HANDLE_VALUE;
+#else
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+#endif // _WIN32
+
+  m_size   = 0;
+  m_direct = false;
+}
+
+/**
+ * @brief Reads a range of the file, without moving any file position
+ *
+ * @param[in] offset  unsigned long long first byte of the range
+ * @param[in] ptr     an (unsigned char) pointer to an allocated buffer
+ * @param[in] size    size_t of the range in bytes
+ *
+ * Throws if the range is not entirely read. In direct mode, the
+ *range and the buffer must be aligned on direct_alignment, and the
+ *range may extend past the end of the file.
+ *******************************************************************/
+void FileReader::read(unsigned long long offset, unsigned char *ptr, size_t size) const
+{
+  while (size > 0) {
+    // The aligned range of a direct read is read up to the end of the file
+    if (m_direct && (offset >= m_size))
+      break;
+
+#if defined(_WIN32)
+    OVERLAPPED overlapped = {};
+    overlapped.Offset     = DWORD(offset);
+    overlapped.OffsetHigh = DWORD(offset >> 32);
+
+    DWORD count;
+    const DWORD chunk = DWORD(min<size_t>(size, 1 << 30));
+    if (!ReadFile(m_handle, ptr, chunk, &count, &overlapped) || (count == 0))
+      throw LIMA_EXC(CameraPlugin, Error, "Failed to read file");
+#else
+    ssize_t count = pread(m_fd, ptr, size, off_t(offset));
+    if ((count < 0) && (errno == EINTR))
+      continue;
+    if (count <= 0)
+      throw LIMA_EXC(CameraPlugin, Error, "Failed to read file");
+#endif // _WIN32
+
+    offset += count;
+    ptr += count;
+    size -= count;
+  }
+}
+
+AlignedBuffer::AlignedBuffer(size_t size) : m_data(NULL), m_size(size)
+{
+#if defined(_WIN32)
+  m_data = static_cast<unsigned char *>(_aligned_malloc(size, FileReader::direct_alignment));
+#else
+  void *data;
+  if (posix_memalign(&data, FileReader::direct_alignment, size) == 0)
+    m_data = static_cast<unsigned char *>(data);
+#endif // _WIN32
+  if (!m_data)
+    throw LIMA_EXC(CameraPlugin, Error, "Failed to allocate an aligned buffer");
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+#if defined(_WIN32)
+  _aligned_free(m_data);
+#else
+  free(m_data);
+#endif // _WIN32
+}
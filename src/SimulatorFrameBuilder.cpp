@@ -25,6 +25,10 @@
 #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <memory>
 #include <vector>
 #ifdef __unix
 #include <sys/time.h>
@@ -33,7 +37,15 @@
 #include <processlib/win/time_compat.h>
 #include <processlib/win/unistd.h>
 #endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "simulator/SimulatorFrameBuilder.h"
+#include "simulator/SimulatorFrameKernels.h"
 #include "lima/SizeUtils.h"
 
 using namespace lima;
@@ -94,10 +106,24 @@ void FrameBuilder::init(FrameDim &frame_dim, Bin &bin, Roi &roi, const PeakList
   m_bin       = bin;
   m_roi       = roi;
 
-  setPeaks(peaks);
+  m_fill_type    = Gauss;
+  m_render_mode  = Separable;
+  m_binning_mode = Sampled;
+  m_peak_cutoff  = 8;
+
+  m_nb_threads  = 0;
+  m_pin_threads = false;
+  m_tile_width  = 256;
+  m_tile_height = 64;
 
-  m_fill_type = Gauss;
-  m_rot_axis  = RotationY;
+  m_noise.seed        = 0;
+  m_noise.shot_noise  = false;
+  m_noise.read_noise  = 0;
+  m_noise.dark_offset = 0;
+
+  m_instruction_set = FrameKernels::getCpuInstructionSet();
+  m_kernels         = &FrameKernels::get(m_instruction_set);
+  m_rot_axis    = RotationY;
 
   m_grow_factor = grow_factor;
   m_rot_angle   = 0;
@@ -107,6 +133,16 @@ void FrameBuilder::init(FrameDim &frame_dim, Bin &bin, Roi &roi, const PeakList
 
   m_diffract_sx = 0;
   m_diffract_sy = 0;
+
+  m_module_size  = frame_dim.getSize();
+  m_gap_size     = Size(0, 0);
+  m_nb_modules_x = 1;
+  m_nb_modules_y = 1;
+  m_gap_value    = 0;
+  m_module_order = false;
+
+  setPeaks(peaks);
+  selectFillFunction();
 }
 
 /**
@@ -148,9 +184,7 @@ void FrameBuilder::checkValid(const FrameDim &frame_dim, const Bin &bin, const R
  *******************************************************************/
 void FrameBuilder::checkPeaks(PeakList const &peaks)
 {
-  Size max_size;
-  getMaxImageSize(max_size);
-  Roi roi = Roi(0, max_size);
+  Roi roi = Roi(0, m_frame_dim.getSize());
 
   vector<GaussPeak>::const_iterator p;
   for (p = peaks.begin(); p != peaks.end(); ++p) {
@@ -175,11 +209,82 @@ void FrameBuilder::getFrameDim(FrameDim &dim) const
  *******************************************************************/
 void FrameBuilder::getEffectiveFrameDim(FrameDim &dim) const
 {
-  dim = m_frame_dim / m_bin;
+  Size max_size;
+  getMaxImageSize(max_size);
+  dim = FrameDim(max_size, m_frame_dim.getImageType()) / m_bin;
   if (!m_roi.isEmpty())
     dim.setSize(m_roi.getSize());
 }
 
+/**
+ * @brief Gets the maximum "hardware" image size
+ *
+ * The frame size, or the modules stacked vertically in module
+ *order (see setModuleOrder())
+ *
+ * @param[out] max_size  Size object reference
+ *******************************************************************/
+void FrameBuilder::getMaxImageSize(Size &max_size) const
+{
+  max_size = m_frame_dim.getSize();
+  if (m_module_order)
+    max_size = Size(m_module_size.getWidth(), m_module_size.getHeight() * m_nb_modules_x * m_nb_modules_y);
+}
+
+/**
+ * @brief Gets the image type of the frames
+ *
+ * @param[out] image_type  ImageType
+ *******************************************************************/
+void FrameBuilder::getImageType(ImageType &image_type) const
+{
+  image_type = m_frame_dim.getImageType();
+}
+
+/**
+ * @brief Sets the image type of the frames, keeping their size
+ *
+ * The pixels are truncated and saturated to the integer types,
+ *rounded to Bpp32F. The signed types keep the negative values
+ *(e.g. read noise around a null dark offset). The 10, 12 and 14-bit
+ *types are saturated to their range in 16-bit words, the 24-bit
+ *ones in 32-bit words, the Camera may pack them (setPackedBits).
+ *
+ * @param[in] image_type  Bpp8, Bpp10, Bpp12, Bpp14, Bpp16, Bpp24,
+ *Bpp32, Bpp64 or their signed variant, or Bpp32F
+ *
+ * @exception lima::Exception  Unsupported image type
+ *******************************************************************/
+void FrameBuilder::setImageType(ImageType image_type)
+{
+  switch (image_type) {
+  case Bpp8:
+  case Bpp8S:
+  case Bpp16:
+  case Bpp16S:
+  case Bpp32:
+  case Bpp32S:
+  case Bpp32F:
+  case Bpp64:
+  case Bpp64S:
+  case Bpp10:
+  case Bpp10S:
+  case Bpp12:
+  case Bpp12S:
+  case Bpp14:
+  case Bpp14S:
+  case Bpp24:
+  case Bpp24S:
+    break;
+  default:
+    throw LIMA_HW_EXC(InvalidValue, "Image type not supported");
+  }
+
+  FrameDim dim = m_frame_dim;
+  dim.setImageType(image_type);
+  setFrameDim(dim);
+}
+
 /**
  * @brief Sets frame dimention
  *
@@ -187,8 +292,9 @@ void FrameBuilder::getEffectiveFrameDim(FrameDim &dim) const
  *******************************************************************/
 void FrameBuilder::setFrameDim(const FrameDim &dim)
 {
+  // A new image type keeps the RoI
   Roi roi = m_roi;
-  if (dim != m_frame_dim)
+  if (dim.getSize() != m_frame_dim.getSize())
     roi.reset();
   checkValid(dim, m_bin, roi);
 
@@ -197,6 +303,19 @@ void FrameBuilder::setFrameDim(const FrameDim &dim)
 
   m_frame_dim = dim;
   m_roi = roi;
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+  selectFillFunction();
+
+  // A new size not set by setModuleLayout() makes a single module
+  Size layout_size(m_nb_modules_x * m_module_size.getWidth() + (m_nb_modules_x - 1) * m_gap_size.getWidth(),
+                   m_nb_modules_y * m_module_size.getHeight() + (m_nb_modules_y - 1) * m_gap_size.getHeight());
+  if (layout_size != new_size) {
+    m_module_size  = new_size;
+    m_gap_size     = Size(0, 0);
+    m_nb_modules_x = 1;
+    m_nb_modules_y = 1;
+  }
 
   // Keep aspect-ratio of peaks' positions
   vector<GaussPeak>::iterator p;
@@ -206,7 +325,9 @@ void FrameBuilder::setFrameDim(const FrameDim &dim)
   }
 
   // Signal LiMA core that the frame properties may have changed
-  maxImageSizeChanged(m_frame_dim.getSize(), m_frame_dim.getImageType());
+  Size max_size;
+  getMaxImageSize(max_size);
+  maxImageSizeChanged(max_size, m_frame_dim.getImageType());
 
   // Reset Bin and RoI?
 }
@@ -229,20 +350,35 @@ void FrameBuilder::getBin(Bin &bin) const
 void FrameBuilder::setBin(const Bin &bin)
 {
   checkValid(m_frame_dim, bin, m_roi);
+  checkModuleLayout(m_module_size, m_gap_size, m_nb_modules_x, m_nb_modules_y, bin);
 
   m_bin = bin;
+  invalidateSprites();
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+  selectFillFunction();
 }
 
 /**
  * @brief Returns the closest Binning supported by the
  *"hardware"
  *
+ * Sampled binning supports 1 or 2, Integrated binning supports
+ *any factor up to the frame size
+ *
  * @param[in,out] bin  Bin object reference
  *******************************************************************/
 void FrameBuilder::checkBin(Bin &bin) const
 {
-  int binX = ((bin.getX() % 2) == 0) ? 2 : 1;
-  int binY = ((bin.getY() % 2) == 0) ? 2 : 1;
+  int binX, binY;
+  if (m_binning_mode == Integrated) {
+    Size size = m_frame_dim.getSize();
+    binX      = std::max(1, std::min(bin.getX(), size.getWidth()));
+    binY      = std::max(1, std::min(bin.getY(), size.getHeight()));
+  } else {
+    binX = ((bin.getX() % 2) == 0) ? 2 : 1;
+    binY = ((bin.getY() % 2) == 0) ? 2 : 1;
+  }
   bin = Bin(binX, binY);
 }
 
@@ -263,9 +399,13 @@ void FrameBuilder::getRoi(Roi &roi) const
  *******************************************************************/
 void FrameBuilder::setRoi(const Roi &roi)
 {
+  if (m_module_order && !roi.isEmpty())
+    throw LIMA_HW_EXC(NotSupported, "RoI not supported in module order");
   checkValid(m_frame_dim, m_bin, roi);
   m_roi = roi;
   checkRoi(m_roi);
+  invalidateBaseFrame();
+  m_frame_cache.clear();
 }
 
 /**
@@ -312,6 +452,10 @@ void FrameBuilder::setPeaks(const PeakList &peaks)
   m_peaks = peaks;
   while (m_peak_angles.size() < m_peaks.size())
     m_peak_angles.push_back(0);
+
+  invalidateSprites();
+  if (m_fill_type == Gauss) invalidateBaseFrame();
+  m_frame_cache.clear();
 }
 
 /**
@@ -332,6 +476,9 @@ void FrameBuilder::getPeakAngles(std::vector<double> &angles) const
 void FrameBuilder::setPeakAngles(const std::vector<double> &angles)
 {
   m_peak_angles = angles;
+
+  if (m_fill_type == Gauss) invalidateBaseFrame();
+  m_frame_cache.clear();
 }
 
 /**
@@ -345,13 +492,357 @@ void FrameBuilder::getFillType(FillType &fill_type) const
 }
 
 /**
- * @brief Gets the image filling type
+ * @brief Sets the image filling type
+ *
+ * Photons samples the photons of the Gauss peaks (see
+ *getPhotonEvents()) at a cost proportional to their number, for
+ *counting detectors at a low flux.
  *
  * @param[in] fill_type  FillType
  *******************************************************************/
 void FrameBuilder::setFillType(FillType fill_type)
 {
   m_fill_type = fill_type;
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+  selectFillFunction();
+}
+
+/**
+ * @brief Gets the rendering algorithm
+ *
+ * @param[out] render_mode  RenderMode
+ *******************************************************************/
+void FrameBuilder::getRenderMode(RenderMode &render_mode) const
+{
+  render_mode = m_render_mode;
+}
+
+/**
+ * @brief Sets the rendering algorithm
+ *
+ * Reference evaluates every peak at every sub-pixel. Otherwise the
+ *Gauss frames are rendered by separability and the Diffraction
+ *frames with the vectorized kernels.
+ *
+ * Sprite renders each peak shape once per acquisition, for 256
+ *sub-pixel positions of its center, and interpolates the profiles
+ *of the peaks from these sprites instead of evaluating them for
+ *every frame. The interpolation error is about 5e-6 of the binned
+ *peak maximum for a FWHM of 2 pixels, and decreases as 1/FWHM^2.
+ *The sprites are limited to 64 MiB, the other peak shapes and a
+ *null peak cut-off fall back to Separable.
+ *
+ * @param[in] render_mode  RenderMode
+ *******************************************************************/
+void FrameBuilder::setRenderMode(RenderMode render_mode)
+{
+  m_render_mode = render_mode;
+  if (m_render_mode != Sprite)
+    invalidateSprites();
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+  selectFillFunction();
+}
+
+/**
+ * @brief Gets the "hardware" binning emulation
+ *
+ * @param[out] binning_mode  BinningMode
+ *******************************************************************/
+void FrameBuilder::getBinningMode(BinningMode &binning_mode) const
+{
+  binning_mode = m_binning_mode;
+}
+
+/**
+ * @brief Sets the "hardware" binning emulation
+ *
+ * Sampled sums the binX x binY sub-pixels of each bin. Integrated
+ *integrates the Gauss peaks analytically over the bin area (erf)
+ *and evaluates the Diffraction pattern at the bin center, so the
+ *cost does not depend on the bin factor. The Reference render mode
+ *always samples.
+ *
+ * @param[in] binning_mode  BinningMode
+ *
+ * @exception lima::Exception  The current Bin is not supported
+ *by the new mode
+ *******************************************************************/
+void FrameBuilder::setBinningMode(BinningMode binning_mode)
+{
+  BinningMode prev_mode = m_binning_mode;
+  m_binning_mode        = binning_mode;
+
+  Bin valid_bin = m_bin;
+  checkBin(valid_bin);
+  if (valid_bin != m_bin) {
+    m_binning_mode = prev_mode;
+    throw LIMA_HW_EXC(InvalidValue, "Current bin not supported by this binning mode");
+  }
+
+  invalidateSprites();
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+}
+
+/**
+ * @brief Gets the peak footprint cut-off
+ *
+ * @param[out] nb_sigma  double
+ *******************************************************************/
+void FrameBuilder::getPeakCutoff(double &nb_sigma) const
+{
+  nb_sigma = m_peak_cutoff;
+}
+
+/**
+ * @brief Sets the peak footprint cut-off
+ *
+ * With the Separable render mode, each peak is only evaluated in
+ *a box of +/- nb_sigma around its center, the rest of the frame
+ *being cleared. 0 disables the culling.
+ *
+ * @param[in] nb_sigma  double
+ *******************************************************************/
+void FrameBuilder::setPeakCutoff(const double &nb_sigma)
+{
+  if (nb_sigma < 0)
+    throw LIMA_HW_EXC(InvalidValue, "Invalid peak cut-off");
+
+  m_peak_cutoff = nb_sigma;
+
+  invalidateSprites();
+  if (m_fill_type == Gauss) invalidateBaseFrame();
+  m_frame_cache.clear();
+}
+
+/**
+ * @brief Gets the upper bound of the error introduced by the
+ *peak footprint cut-off
+ *
+ * A pixel outside of a peak box is at more than nb_sigma from its
+ *center on at least one axis, so the neglected contribution is
+ *below max * exp(-nb_sigma^2 / 2) per sub-pixel. The bound is
+ *given for the first frame, it scales with the grow factor.
+ *
+ * @param[out] max_error  double, per (binned) pixel
+ *******************************************************************/
+void FrameBuilder::getPeakCutoffError(double &max_error) const
+{
+  max_error = 0.0;
+  if (m_peak_cutoff == 0)
+    return;
+
+  vector<GaussPeak>::const_iterator p;
+  for (p = m_peaks.begin(); p != m_peaks.end(); ++p)
+    max_error += fabs(p->max);
+  max_error *= exp(-m_peak_cutoff * m_peak_cutoff / 2) * m_bin.getX() * m_bin.getY();
+}
+
+/**
+ * @brief Gets the instruction set of the rendering kernels
+ *
+ * @param[out] instruction_set  FrameKernels::InstructionSet
+ *******************************************************************/
+void FrameBuilder::getInstructionSet(FrameKernels::InstructionSet &instruction_set) const
+{
+  instruction_set = m_instruction_set;
+}
+
+/**
+ * @brief Sets the instruction set of the rendering kernels
+ *
+ * Defaults to the best one supported by the CPU. Scalar selects
+ *the libm based kernels, used as a reference for the others.
+ *
+ * @param[in] instruction_set  FrameKernels::InstructionSet
+ *
+ * @exception lima::Exception  The CPU does not support it
+ *******************************************************************/
+void FrameBuilder::setInstructionSet(FrameKernels::InstructionSet instruction_set)
+{
+  m_kernels         = &FrameKernels::get(instruction_set);
+  m_instruction_set = instruction_set;
+  invalidateSprites();
+  invalidateBaseFrame();
+  m_frame_cache.clear();
+}
+
+/**
+ * @brief Gets the number of threads generating a frame
+ *
+ * @param[out] nb_threads  int
+ *******************************************************************/
+void FrameBuilder::getNbThreads(int &nb_threads) const
+{
+  nb_threads = m_nb_threads;
+}
+
+/**
+ * @brief Sets the number of threads generating a frame
+ *
+ * The rows of a frame (the tiles of a Separable Gauss frame, see
+ *setTileSize()) are split over the threads. 0 lets OpenMP
+ *choose (one thread per core by default). When getFrame() is
+ *already called from a parallel region, e.g. by the
+ *FramePrefetcher, each frame is generated by a single thread.
+ *
+ * @param[in] nb_threads  int
+ *******************************************************************/
+void FrameBuilder::setNbThreads(int nb_threads)
+{
+  if (nb_threads < 0)
+    throw LIMA_HW_EXC(InvalidValue, "Invalid number of threads");
+
+  m_nb_threads = nb_threads;
+}
+
+/**
+ * @brief Gets whether the generating threads are pinned to cores
+ *
+ * @param[out] pin_threads  bool
+ *******************************************************************/
+void FrameBuilder::getPinThreads(bool &pin_threads) const
+{
+  pin_threads = m_pin_threads;
+}
+
+/**
+ * @brief Sets whether the generating threads are pinned to cores
+ *
+ * Thread i of the team, including the calling thread as thread 0,
+ *is pinned to the i-th CPU of the process affinity mask. Only
+ *supported on Linux, ignored otherwise.
+ *
+ * @param[in] pin_threads  bool
+ *******************************************************************/
+void FrameBuilder::setPinThreads(bool pin_threads)
+{
+  m_pin_threads = pin_threads;
+}
+
+/**
+ * @brief Gets the tile size of the Separable renderer
+ *
+ * @param[out] width, height  int in binned pixels
+ *******************************************************************/
+void FrameBuilder::getTileSize(int &width, int &height) const
+{
+  width  = m_tile_width;
+  height = m_tile_height;
+}
+
+/**
+ * @brief Sets the tile size of the Separable renderer
+ *
+ * The Gauss frames are rendered by tiles, each tile being
+ *accumulated in a buffer of width x height doubles before being
+ *written to the frame, and the tiles are split over the threads.
+ *The default 256x64 (128 KB) fits in the L2 cache of most CPUs.
+ *A tile width larger than the frame renders full rows.
+ *
+ * @param[in] width, height  int in binned pixels
+ *******************************************************************/
+void FrameBuilder::setTileSize(int width, int height)
+{
+  if ((width <= 0) || (height <= 0))
+    throw LIMA_HW_EXC(InvalidValue, "Invalid tile size");
+
+  m_tile_width  = width;
+  m_tile_height = height;
+}
+
+/**
+ * @brief Gets whether the Poisson (shot) noise is enabled
+ *
+ * @param[out] shot_noise  bool
+ *******************************************************************/
+void FrameBuilder::getShotNoise(bool &shot_noise) const
+{
+  shot_noise = m_noise.shot_noise;
+}
+
+/**
+ * @brief Enables the Poisson (shot) noise
+ *
+ * The noise-free pixel value is taken as the mean number of
+ *photons, with a gain of 1 count per photon. It is sampled exactly
+ *below 32 photons and with the normal approximation above.
+ *
+ * @param[in] shot_noise  bool
+ *******************************************************************/
+void FrameBuilder::setShotNoise(bool shot_noise)
+{
+  m_noise.shot_noise = shot_noise;
+}
+
+/**
+ * @brief Gets the Gaussian read noise
+ *
+ * @param[out] sigma  double standard deviation in counts
+ *******************************************************************/
+void FrameBuilder::getReadNoise(double &sigma) const
+{
+  sigma = m_noise.read_noise;
+}
+
+/**
+ * @brief Sets the Gaussian read noise, 0 to disable it
+ *
+ * @param[in] sigma  double standard deviation in counts
+ *******************************************************************/
+void FrameBuilder::setReadNoise(const double &sigma)
+{
+  if (sigma < 0)
+    throw LIMA_HW_EXC(InvalidValue, "Invalid read noise");
+
+  m_noise.read_noise = sigma;
+}
+
+/**
+ * @brief Gets the dark offset
+ *
+ * @param[out] offset  double counts
+ *******************************************************************/
+void FrameBuilder::getDarkOffset(double &offset) const
+{
+  offset = m_noise.dark_offset;
+}
+
+/**
+ * @brief Sets the dark offset, a constant added to every pixel
+ *
+ * @param[in] offset  double counts
+ *******************************************************************/
+void FrameBuilder::setDarkOffset(const double &offset)
+{
+  m_noise.dark_offset = offset;
+}
+
+/**
+ * @brief Gets the seed of the noise generator
+ *
+ * @param[out] seed  unsigned int
+ *******************************************************************/
+void FrameBuilder::getNoiseSeed(unsigned int &seed) const
+{
+  seed = m_noise.seed;
+}
+
+/**
+ * @brief Sets the seed of the noise generator
+ *
+ * The noise is drawn from a counter-based generator (Philox4x32-10)
+ *keyed on the seed, the frame number and the binned pixel
+ *position: a frame is reproducible whatever the number of threads,
+ *the prefetching or the RoI.
+ *
+ * @param[in] seed  unsigned int
+ *******************************************************************/
+void FrameBuilder::setNoiseSeed(unsigned int seed)
+{
+  m_noise.seed = seed;
 }
 
 /**
@@ -372,6 +863,9 @@ void FrameBuilder::getRotationAxis(RotationAxis &rot_axis) const
 void FrameBuilder::setRotationAxis(RotationAxis rot_axis)
 {
   m_rot_axis = rot_axis;
+
+  if (m_fill_type == Gauss) invalidateBaseFrame();
+  m_frame_cache.clear();
 }
 
 /**
@@ -392,6 +886,8 @@ void FrameBuilder::getRotationAngle(double &a) const
 void FrameBuilder::setRotationAngle(const double &a)
 {
   m_rot_angle = a;
+
+  if (m_fill_type == Gauss) invalidateBaseFrame();
 }
 
 /**
@@ -412,6 +908,8 @@ void FrameBuilder::getRotationSpeed(double &s) const
 void FrameBuilder::setRotationSpeed(const double &s)
 {
   m_rot_speed = s;
+
+  if (m_fill_type == Gauss) invalidateBaseFrame();
 }
 
 /**
@@ -481,53 +979,735 @@ void FrameBuilder::setDiffractionSpeed(const double &sx, const double &sy)
   m_diffract_sy = sy;
 }
 
-#define SGM_FWHM 0.42466090014400952136075141705144 // 1/(2*sqrt(2*ln(2)))
-
 /**
- * @brief Calculates Gauss(x,y) for given peak
- *parameters
+ * @brief Gets the module layout of the detector
  *
- * @param[in] x     double X-coord
- * @param[in] y     double Y-coord
- * @param[in] x0    double X-coord of the center
- * @param[in] y0    double Y-coord of the center
- * @param[in] fwhm  double Full Width at Half Maximum
- * @param[in] max   double the central maximum value
- * @return Gauss(x,y) double
+ * @param[out] module_size   Size of a module
+ * @param[out] gap_size      Size of the gaps between modules
+ * @param[out] nb_modules_x  int number of modules in X
+ * @param[out] nb_modules_y  int number of modules in Y
  *******************************************************************/
-double FrameBuilder::gauss2D(double x, double y, double x0, double y0, double fwhm, double max)
+void FrameBuilder::getModuleLayout(Size &module_size, Size &gap_size, int &nb_modules_x, int &nb_modules_y) const
 {
-  double sigma = SGM_FWHM * fabs(fwhm);
-  return max * exp(-((x - x0) * (x - x0) + (y - y0) * (y - y0)) / (2 * sigma * sigma));
+  module_size  = m_module_size;
+  gap_size     = m_gap_size;
+  nb_modules_x = m_nb_modules_x;
+  nb_modules_y = m_nb_modules_y;
 }
 
-FrameBuilder::PeakList FrameBuilder::getGaussPeaksFrom3d(double angle) const
+/**
+ * @brief Sets the module layout of the detector
+ *
+ * The frame is made of nb_modules_x x nb_modules_y modules
+ *separated by gaps, its size is set accordingly (the image type
+ *is kept). The peaks are positioned in this assembled frame, the
+ *gap pixels are set to the gap value (see setGapValue()). Each
+ *module is rendered independently, one module per thread when
+ *there are at least as many modules as threads.
+ *
+ * With more than one module, the module and gap sizes must be
+ *multiples of the bin. setFrameDim() with another size resets the
+ *layout to a single module.
+ *
+ * @param[in] module_size   Size of a module
+ * @param[in] gap_size      Size of the gaps between modules
+ * @param[in] nb_modules_x  int number of modules in X
+ * @param[in] nb_modules_y  int number of modules in Y
+ *
+ * @exception lima::Exception  The layout is invalid or not
+ *compatible with the bin
+ *******************************************************************/
+void FrameBuilder::setModuleLayout(const Size &module_size, const Size &gap_size, int nb_modules_x,
+                                   int nb_modules_y)
 {
-  PeakList gauss_peaks;
-  PeakList::const_iterator pit, pend            = m_peaks.end();
-  std::vector<double>::const_iterator ait, aend = m_peak_angles.end();
-
-  int rot_y  = (m_rot_axis == RotationY);
-  Size size  = m_frame_dim.getSize();
-  int dim    = rot_y ? size.getWidth() : size.getHeight();
-  int center = dim / 2;
-  for (pit = m_peaks.begin(), ait = m_peak_angles.begin(); (pit != pend) && (ait != aend); ++pit, ++ait) {
-    double rad    = (angle + *ait) * M_PI / 180;
-    double x      = pit->x0;
-    double y      = pit->y0;
-    double *coord = rot_y ? &x : &y;
-    double r      = abs(center - *coord);
-    if (center > *coord) rad += M_PI;
-    *coord = center + int(r * cos(rad));
-    GaussPeak peak(x, y, pit->fwhm, pit->max);
-    gauss_peaks.push_back(peak);
-  }
-
-  return gauss_peaks;
+  if ((nb_modules_x <= 0) || (nb_modules_y <= 0) || module_size.isEmpty() || (gap_size.getWidth() < 0) ||
+      (gap_size.getHeight() < 0))
+    throw LIMA_HW_EXC(InvalidValue, "Invalid module layout");
+  checkModuleLayout(module_size, gap_size, nb_modules_x, nb_modules_y, m_bin);
+
+  Size size(nb_modules_x * module_size.getWidth() + (nb_modules_x - 1) * gap_size.getWidth(),
+            nb_modules_y * module_size.getHeight() + (nb_modules_y - 1) * gap_size.getHeight());
+  FrameDim frame_dim(size, m_frame_dim.getImageType());
+  checkValid(frame_dim, m_bin, Roi());
+
+  m_module_size  = module_size;
+  m_gap_size     = gap_size;
+  m_nb_modules_x = nb_modules_x;
+  m_nb_modules_y = nb_modules_y;
+  setFrameDim(frame_dim);
 }
 
 /**
- * @brief Calculates the summary intensity at certain
+ * @brief Checks that a module layout can be binned
+ *
+ * @exception lima::Exception  The module or gap size is not a
+ *multiple of the bin
+ *******************************************************************/
+void FrameBuilder::checkModuleLayout(const Size &module_size, const Size &gap_size, int nb_modules_x,
+                                     int nb_modules_y, const Bin &bin) const
+{
+  if (nb_modules_x * nb_modules_y == 1)
+    return;
+
+  int binX = bin.getX();
+  int binY = bin.getY();
+  if ((module_size.getWidth() % binX) || (module_size.getHeight() % binY) || (gap_size.getWidth() % binX) ||
+      (gap_size.getHeight() % binY))
+    throw LIMA_HW_EXC(InvalidValue, "Module layout not compatible with the bin");
+}
+
+/**
+ * @brief Gets the value of the gap pixels
+ *
+ * @param[out] value  double
+ *******************************************************************/
+void FrameBuilder::getGapValue(double &value) const
+{
+  value = m_gap_value;
+}
+
+/**
+ * @brief Sets the value of the gap pixels, saturated to the
+ *image type (default is 0)
+ *
+ * @param[in] value  double
+ *******************************************************************/
+void FrameBuilder::setGapValue(const double &value)
+{
+  m_gap_value = value;
+  m_frame_cache.clear();
+}
+
+/**
+ * @brief Gets whether the frames are delivered module by module
+ *
+ * @param[out] module_order  bool
+ *******************************************************************/
+void FrameBuilder::getModuleOrder(bool &module_order) const
+{
+  module_order = m_module_order;
+}
+
+/**
+ * @brief Sets whether the frames are delivered module by module
+ *
+ * In module order a frame is made of the modules one after the
+ *other, without gaps, as read out by the detector: the image is
+ *the modules stacked vertically, in row-major module order. The
+ *pixel values are the same as in the assembled frame.
+ *
+ * @param[in] module_order  bool
+ *
+ * @exception lima::Exception  A RoI is set
+ *******************************************************************/
+void FrameBuilder::setModuleOrder(bool module_order)
+{
+  if (module_order && !m_roi.isEmpty())
+    throw LIMA_HW_EXC(NotSupported, "RoI not supported in module order");
+
+  m_module_order = module_order;
+  m_frame_cache.clear();
+
+  // Signal LiMA core that the frame properties may have changed
+  Size max_size;
+  getMaxImageSize(max_size);
+  maxImageSizeChanged(max_size, m_frame_dim.getImageType());
+}
+
+/**
+ * @brief Gets the memory budget of the frame cache
+ *
+ * @param[out] size_mb  int in MiB, 0 if disabled
+ *******************************************************************/
+void FrameBuilder::getFrameCacheSize(int &size_mb) const
+{
+  size_t max_size;
+  m_frame_cache.getMaxSize(max_size);
+  size_mb = int(max_size >> 20);
+}
+
+/**
+ * @brief Sets the memory budget of the frame cache
+ *
+ * With a rotation speed dividing 360 degrees and no grow factor,
+ *the Gauss frames repeat with a period of 360 / speed frames (and
+ *the Diffraction frames with a null Diffraction speed). The cache
+ *keeps the least recently used frames, keyed on the rotation
+ *angle (modulo 360, within 1e-9 degree), the Diffraction position,
+ *the scale and the frame geometry, so that a repeated frame is a
+ *copy. Any other setting clears it. The frames that cannot repeat
+ *(with a grow factor, a Diffraction speed or noise) are not cached.
+ *
+ * @param[in] size_mb  int in MiB, 0 disables the cache (default)
+ *
+ * @exception lima::Exception  Negative size
+ *******************************************************************/
+void FrameBuilder::setFrameCacheSize(int size_mb)
+{
+  if (size_mb < 0)
+    throw LIMA_HW_EXC(InvalidValue, "Invalid frame cache size");
+
+  m_frame_cache.setMaxSize(size_t(size_mb) << 20);
+}
+
+/**
+ * @brief Gets the number of frames copied from the cache since the
+ *last prepareAcq()
+ *
+ * @param[out] hits  unsigned long
+ *******************************************************************/
+void FrameBuilder::getFrameCacheHits(unsigned long &hits) const
+{
+  unsigned long misses;
+  m_frame_cache.getStats(hits, misses);
+}
+
+/**
+ * @brief Gets the number of frames generated with the cache
+ *enabled since the last prepareAcq()
+ *
+ * @param[out] misses  unsigned long
+ *******************************************************************/
+void FrameBuilder::getFrameCacheMisses(unsigned long &misses) const
+{
+  unsigned long hits;
+  m_frame_cache.getStats(hits, misses);
+}
+
+#define SGM_FWHM 0.42466090014400952136075141705144 // 1/(2*sqrt(2*ln(2)))
+
+/**
+ * @brief Calculates Gauss(x,y) for given peak
+ *parameters
+ *
+ * @param[in] x     double X-coord
+ * @param[in] y     double Y-coord
+ * @param[in] x0    double X-coord of the center
+ * @param[in] y0    double Y-coord of the center
+ * @param[in] fwhm  double Full Width at Half Maximum
+ * @param[in] max   double the central maximum value
+ * @return Gauss(x,y) double
+ *******************************************************************/
+double FrameBuilder::gauss2D(double x, double y, double x0, double y0, double fwhm, double max)
+{
+  double sigma = SGM_FWHM * fabs(fwhm);
+  return max * exp(-((x - x0) * (x - x0) + (y - y0) * (y - y0)) / (2 * sigma * sigma));
+}
+
+/**
+ * @brief Returns the number of threads of the next parallel
+ *region generating a frame
+ *******************************************************************/
+int FrameBuilder::getNbWorkers() const
+{
+#ifdef _OPENMP
+  if (omp_in_parallel())
+    return 1;
+  return (m_nb_threads > 0) ? m_nb_threads : omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+/**
+ * @brief Pins the calling worker of a parallel region to its core,
+ *if requested. The master thread is the caller of the region and
+ *keeps its affinity, so that the threads it creates later do not
+ *inherit a single-CPU mask
+ *******************************************************************/
+void FrameBuilder::pinWorker() const
+{
+#if defined(__linux__) && defined(_OPENMP)
+  // The CPUs the process is allowed to run on, taken once before any pinning
+  static const struct ProcessCpus {
+    cpu_set_t set;
+    bool valid;
+    ProcessCpus() { valid = (sched_getaffinity(getpid(), sizeof(set), &set) == 0); }
+  } process_cpus;
+
+  static thread_local int pinned_cpu = -1;
+
+  if (!process_cpus.valid || (omp_get_thread_num() == 0))
+    return;
+
+  if (!m_pin_threads) {
+    // Release a worker pinned by a previous frame
+    if ((pinned_cpu >= 0) && (pthread_setaffinity_np(pthread_self(), sizeof(process_cpus.set), &process_cpus.set) == 0))
+      pinned_cpu = -1;
+    return;
+  }
+
+  // Map the thread number to the allowed CPUs
+  int nb_cpus = CPU_COUNT(&process_cpus.set);
+  int target  = omp_get_thread_num() % nb_cpus;
+  int cpu     = -1;
+  for (int i = 0; (i < CPU_SETSIZE) && (target >= 0); i++)
+    if (CPU_ISSET(i, &process_cpus.set) && (target-- == 0))
+      cpu = i;
+
+  if ((cpu < 0) || (cpu == pinned_cpu))
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    pinned_cpu = cpu;
+#endif
+}
+
+/**
+ * @brief Calculates the binned 1-D profile of a Gauss peak,
+ *normalized to 1 at its center
+ *
+ * @param[in]  x0       double center of the peak (unbinned)
+ * @param[in]  fwhm     double Full Width at Half Maximum
+ * @param[in]  bin      int bin factor along the axis
+ * @param[in]  b0, n    int range of binned pixels [b0, b0 + n)
+ * @param[out] profile  n doubles
+ *******************************************************************/
+void FrameBuilder::gaussProfile(double x0, double fwhm, int bin, int b0, int n, double *profile) const
+{
+  double sigma = SGM_FWHM * fabs(fwhm);
+  if (m_binning_mode == Integrated)
+    m_kernels->gauss_integral(x0, sigma, bin, b0, n, profile);
+  else
+    m_kernels->gauss_profile(x0, 1 / (2 * sigma * sigma), bin, b0, n, profile);
+}
+
+/// Sub-pixel phases of the peak sprites
+static const int SPRITE_OVERSAMPLING = 256;
+
+/// Max. number of doubles in the peak sprites (64 MiB)
+static const size_t MAX_SPRITES_SIZE = size_t(8) << 20;
+
+/**
+ * @brief Renders the sprite of a peak shape: its binned profile
+ *for each sub-pixel phase of the center, the last phase being the
+ *first one shifted by a pixel
+ *
+ * @param[in]  fwhm    double Full Width at Half Maximum
+ * @param[in]  bin     int
+ * @param[out] sprite  PeakSprite
+ *******************************************************************/
+void FrameBuilder::buildSprite(double fwhm, int bin, PeakSprite &sprite) const
+{
+  // Covers any footprint, see getPeakFootprint()
+  double half = m_peak_cutoff * SGM_FWHM * fabs(fwhm);
+  sprite.half = int(ceil(half / bin)) + 1;
+
+  int size = 2 * sprite.half + 1;
+  sprite.phases.resize(size_t(SPRITE_OVERSAMPLING + 1) * size);
+  for (int p = 0; p <= SPRITE_OVERSAMPLING; p++) {
+    double x0 = bin * double(p) / SPRITE_OVERSAMPLING;
+    gaussProfile(x0, fwhm, bin, -sprite.half, size, &sprite.phases[size_t(p) * size]);
+  }
+}
+
+/**
+ * @brief Calculates the binned 1-D profile of a peak by linear
+ *interpolation between the two closest phases of its sprite
+ *
+ * @param[in]  sprite   PeakSprite of the peak shape
+ * @param[in]  x0       double center of the peak
+ * @param[in]  bin      int
+ * @param[in]  b0, n    int range of binned pixels [b0, b0 + n),
+ *within the sprite
+ * @param[out] profile  n doubles
+ *******************************************************************/
+void FrameBuilder::spriteProfile(const PeakSprite &sprite, double x0, int bin, int b0, int n, double *profile) const
+{
+  double u     = x0 / bin;
+  double c     = floor(u);
+  double phase = (u - c) * SPRITE_OVERSAMPLING;
+  int p        = std::min(int(phase), SPRITE_OVERSAMPLING - 1);
+  double w     = phase - p;
+
+  int size          = 2 * sprite.half + 1;
+  const double *lo  = &sprite.phases[size_t(p) * size + (b0 - int(c) + sprite.half)];
+  const double *hi  = lo + size;
+  for (int i = 0; i < n; i++)
+    profile[i] = lo[i] + w * (hi[i] - lo[i]);
+}
+
+/**
+ * @brief Renders the sprites of the peak shapes, for the Sprite
+ *render mode
+ *******************************************************************/
+void FrameBuilder::buildSprites()
+{
+  DEB_MEMBER_FUNCT();
+
+  shared_ptr<PeakSprites> sprites = make_shared<PeakSprites>();
+
+  // The peaks whose shape does not fit are rendered by gaussProfile()
+  size_t sprites_size = 0;
+  PeakList::const_iterator it;
+  for (it = m_peaks.begin(); it != m_peaks.end(); ++it) {
+    if (sprites->x.count(it->fwhm))
+      continue;
+    PeakSprite x, y;
+    buildSprite(it->fwhm, m_bin.getX(), x);
+    buildSprite(it->fwhm, m_bin.getY(), y);
+    sprites_size += x.phases.size() + y.phases.size();
+    if (sprites_size > MAX_SPRITES_SIZE)
+      break;
+    sprites->x[it->fwhm] = std::move(x);
+    sprites->y[it->fwhm] = std::move(y);
+  }
+
+  atomic_store(&m_sprites, Sprites(sprites));
+
+  DEB_TRACE() << "Peak sprites cached: " << DEB_VAR1(sprites->x.size());
+}
+
+/**
+ * @brief Releases the peak sprites, they are rebuilt by the next
+ *prepareAcq()
+ *******************************************************************/
+void FrameBuilder::invalidateSprites()
+{
+  atomic_store(&m_sprites, Sprites());
+}
+
+/**
+ * @brief Calculates a binned row of the Diffraction pattern
+ *
+ * @param[in]  bx0, n  int range of binned columns [bx0, bx0 + n)
+ * @param[in]  by      int binned row
+ * @param[out] row     n doubles
+ *******************************************************************/
+void FrameBuilder::diffractRow(int bx0, int by, int n, double *row) const
+{
+  int binX = m_bin.getX();
+  int binY = m_bin.getY();
+
+  // Same center as dataDiffract()
+  double cx = m_frame_dim.getSize().getWidth() / 2;
+  double cy = m_frame_dim.getSize().getHeight() / 2;
+
+  fill(row, row + n, 0.0);
+  if (m_binning_mode == Integrated) {
+    // Midpoint rule: one evaluation at the bin center, times its area
+    double x = bx0 * binX + (binX - 1) / 2.0 - cx;
+    double y = by * binY + (binY - 1) / 2.0 - cy;
+    m_kernels->diffract_row(x, binX, y, n, row);
+    if (binX * binY != 1)
+      for (int i = 0; i < n; i++)
+        row[i] *= binX * binY;
+  } else {
+    for (int y = by * binY; y < by * binY + binY; y++)
+      for (int x = bx0 * binX; x < bx0 * binX + binX; x++)
+        m_kernels->diffract_row(x - cx, binX, y - cy, n, row);
+  }
+}
+
+/**
+ * @brief Returns true if the frames get some noise
+ *******************************************************************/
+bool FrameBuilder::hasNoise() const
+{
+  return m_noise.shot_noise || (m_noise.read_noise > 0) || (m_noise.dark_offset != 0);
+}
+
+/**
+ * @brief Scales a binned row and adds the noise to it
+ *
+ * @param[in]  frame_nr  unsigned long frame number
+ * @param[in]  bx0, by   int binned coordinates of src[0]
+ * @param[in]  src       n doubles, noise-free
+ * @param[in]  scale     double applied to src
+ * @param[out] dst       n doubles, may be src
+ *******************************************************************/
+void FrameBuilder::noiseRow(unsigned long frame_nr, int bx0, int by, const double *src, double scale, double *dst,
+                            int n) const
+{
+  // Index in the full binned frame, so that the noise does not depend on the RoI
+  unsigned long long pixel = (unsigned long long)by * (m_frame_dim.getSize().getWidth() / m_bin.getX()) + bx0;
+  m_kernels->noise_row(m_noise, frame_nr, pixel, src, scale, dst, n);
+}
+
+/**
+ * @brief Clips the footprint of each peak to a region of the
+ *frame and computes its profiles
+ *
+ * @param[in]  rot_angle  double rotation angle of the peaks
+ * @param[in]  scale      double applied to the Y profiles
+ * @param[in]  region     FrameRegion
+ * @param[out] profiles   PeakProfiles
+ *******************************************************************/
+void FrameBuilder::getPeakProfiles(double rot_angle, double scale, const FrameRegion &region,
+                                   PeakProfiles &profiles) const
+{
+  int bx0  = region.bx0, bxM = region.bxM;
+  int by0  = region.by0, byM = region.byM;
+  int binX = m_bin.getX();
+  int binY = m_bin.getY();
+
+  PeakList peaks = getGaussPeaksFrom3d(rot_angle);
+
+  Sprites sprites = atomic_load(&m_sprites);
+
+  vector<double> &x_prof = profiles.x_prof;
+  vector<double> &y_prof = profiles.y_prof;
+  profiles.footprints.reserve(peaks.size());
+  PeakList::const_iterator it;
+  for (it = peaks.begin(); it != peaks.end(); ++it) {
+    PeakFootprint fp;
+    if (!getPeakFootprint(*it, bx0, bxM, by0, byM, fp))
+      continue;
+
+    fp.x_prof = x_prof.size();
+    fp.y_prof = y_prof.size();
+    x_prof.resize(x_prof.size() + (fp.x_end - fp.x_begin));
+    y_prof.resize(y_prof.size() + (fp.y_end - fp.y_begin));
+    map<double, PeakSprite>::const_iterator sx, sy;
+    if (sprites && ((sx = sprites->x.find(it->fwhm)) != sprites->x.end())) {
+      sy = sprites->y.find(it->fwhm);
+      spriteProfile(sx->second, it->x0, binX, fp.x_begin, fp.x_end - fp.x_begin, &x_prof[fp.x_prof]);
+      spriteProfile(sy->second, it->y0, binY, fp.y_begin, fp.y_end - fp.y_begin, &y_prof[fp.y_prof]);
+    } else {
+      gaussProfile(it->x0, it->fwhm, binX, fp.x_begin, fp.x_end - fp.x_begin, &x_prof[fp.x_prof]);
+      gaussProfile(it->y0, it->fwhm, binY, fp.y_begin, fp.y_end - fp.y_begin, &y_prof[fp.y_prof]);
+    }
+    for (size_t j = fp.y_prof; j < y_prof.size(); j++)
+      y_prof[j] *= it->max * scale;
+    profiles.footprints.push_back(fp);
+  }
+
+  buildPeakGrid(bx0, bxM, by0, byM, profiles);
+}
+
+/**
+ * @brief Buckets the peak footprints in a uniform grid of cells
+ *
+ * The cell side is the power of 2 above the mean footprint side,
+ *so each footprint overlaps about 4 cells whatever the peak
+ *size and cut-off. A pixel then only visits the peaks whose
+ *footprint overlaps its cell.
+ *
+ * @param[in]     bx0, bxM  int range of binned columns [bx0, bxM)
+ * @param[in]     by0, byM  int range of binned rows [by0, byM)
+ * @param[in,out] profiles  PeakProfiles with the footprints
+ *******************************************************************/
+void FrameBuilder::buildPeakGrid(int bx0, int bxM, int by0, int byM, PeakProfiles &profiles) const
+{
+  const vector<PeakFootprint> &footprints = profiles.footprints;
+  int nb_peaks                            = footprints.size();
+
+  double mean_side = 0;
+  for (int i = 0; i < nb_peaks; i++)
+    mean_side += std::max(footprints[i].x_end - footprints[i].x_begin, footprints[i].y_end - footprints[i].y_begin);
+  if (nb_peaks > 0)
+    mean_side /= nb_peaks;
+
+  int max_side = std::max(std::max(bxM - bx0, byM - by0), 1);
+  int cell     = 16;
+  while ((cell < mean_side) && (cell < max_side))
+    cell *= 2;
+
+  profiles.cell_size   = cell;
+  profiles.grid_x0     = bx0;
+  profiles.grid_y0     = by0;
+  profiles.grid_width  = (bxM - bx0 + cell - 1) / cell;
+  profiles.grid_height = (byM - by0 + cell - 1) / cell;
+
+  // Counting sort of the (cell, footprint) pairs
+  vector<size_t> &cell_begin = profiles.cell_begin;
+  cell_begin.assign(size_t(profiles.grid_width) * profiles.grid_height + 1, 0);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < nb_peaks; i++) {
+      const PeakFootprint &fp = footprints[i];
+      int cx0 = (fp.x_begin - bx0) / cell, cxM = (fp.x_end - 1 - bx0) / cell + 1;
+      int cy0 = (fp.y_begin - by0) / cell, cyM = (fp.y_end - 1 - by0) / cell + 1;
+      for (int cy = cy0; cy < cyM; cy++) {
+        for (int cx = cx0; cx < cxM; cx++) {
+          size_t c = size_t(cy) * profiles.grid_width + cx;
+          if (pass == 0)
+            cell_begin[c + 1]++;
+          else
+            profiles.cell_peaks[cell_begin[c]++] = i;
+        }
+      }
+    }
+    if (pass == 0) {
+      for (size_t c = 1; c < cell_begin.size(); c++)
+        cell_begin[c] += cell_begin[c - 1];
+      profiles.cell_peaks.resize(cell_begin.back());
+    } else {
+      // The second pass moved each begin to the next one
+      for (size_t c = cell_begin.size() - 1; c > 0; c--)
+        cell_begin[c] = cell_begin[c - 1];
+      cell_begin[0] = 0;
+    }
+  }
+}
+
+/**
+ * @brief Accumulates the peaks overlapping a binned tile
+ *
+ * Only the footprints listed in the grid cells of the tile are
+ *visited, in the order of the peak list, so a pixel gets the same
+ *value whatever the tile size.
+ *
+ * @param[in]     profiles       PeakProfiles
+ * @param[in]     tx0, ty0       int binned coordinates of tile[0]
+ * @param[in]     width, height  int tile size
+ * @param[in,out] peaks          scratch vector, the peaks of the
+ *tile
+ * @param[out]    tile           doubles, width x height with a row
+ *stride, untouched if no peak overlaps the tile
+ * @param[in]     stride         size_t
+ * @return        false if no peak overlaps the tile
+ *******************************************************************/
+bool FrameBuilder::gaussTile(const PeakProfiles &profiles, int tx0, int ty0, int width, int height,
+                             vector<int> &peaks, double *tile, size_t stride) const
+{
+  if (profiles.footprints.empty())
+    return false;
+
+  int cell = profiles.cell_size;
+  int cx0  = (tx0 - profiles.grid_x0) / cell;
+  int cxM  = (tx0 + width - 1 - profiles.grid_x0) / cell + 1;
+  int cy0  = (ty0 - profiles.grid_y0) / cell;
+  int cyM  = (ty0 + height - 1 - profiles.grid_y0) / cell + 1;
+  int txM  = tx0 + width;
+  int tyM  = ty0 + height;
+
+  // A footprint overlapping several cells of the tile is only taken in
+  // the cell of its first pixel in the tile
+  peaks.clear();
+  for (int cy = cy0; cy < cyM; cy++) {
+    const size_t *cells = &profiles.cell_begin[size_t(cy) * profiles.grid_width];
+    for (int cx = cx0; cx < cxM; cx++) {
+      for (size_t j = cells[cx]; j < cells[cx + 1]; j++) {
+        int i                  = profiles.cell_peaks[j];
+        const PeakFootprint &f = profiles.footprints[i];
+        if ((f.x_end <= tx0) || (f.x_begin >= txM) || (f.y_end <= ty0) || (f.y_begin >= tyM))
+          continue;
+        if (((std::max(f.x_begin, tx0) - profiles.grid_x0) / cell != cx) ||
+            ((std::max(f.y_begin, ty0) - profiles.grid_y0) / cell != cy))
+          continue;
+        peaks.push_back(i);
+      }
+    }
+  }
+  if (peaks.empty())
+    return false;
+  sort(peaks.begin(), peaks.end());
+
+  for (int y = 0; y < height; y++)
+    fill(tile + y * stride, tile + y * stride + width, 0.0);
+
+  vector<int>::const_iterator it, end = peaks.end();
+  for (it = peaks.begin(); it != end; ++it) {
+    const PeakFootprint &f = profiles.footprints[*it];
+    int xb                 = std::max(f.x_begin, tx0);
+    int xe                 = std::min(f.x_end, txM);
+    int yb                 = std::max(f.y_begin, ty0);
+    int ye                 = std::min(f.y_end, tyM);
+    const double *x_prof   = &profiles.x_prof[f.x_prof + (xb - f.x_begin)];
+    for (int y = yb; y < ye; y++) {
+      double a = profiles.y_prof[f.y_prof + (y - f.y_begin)];
+      if (a == 0.0)
+        continue;
+      m_kernels->axpy(a, x_prof, tile + (y - ty0) * stride + (xb - tx0), xe - xb);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Gets the range of binned pixels to generate
+ *
+ * @param[out] bx0, bxM  int range of binned columns [bx0, bxM)
+ * @param[out] by0, byM  int range of binned rows [by0, byM)
+ *******************************************************************/
+void FrameBuilder::getBinnedRange(int &bx0, int &bxM, int &by0, int &byM) const
+{
+  if (!m_roi.isEmpty()) {
+    bx0 = m_roi.getTopLeft().x;
+    bxM = m_roi.getBottomRight().x + 1;
+    by0 = m_roi.getTopLeft().y;
+    byM = m_roi.getBottomRight().y + 1;
+  } else {
+    bx0 = by0 = 0;
+    bxM       = m_frame_dim.getSize().getWidth() / m_bin.getX();
+    byM       = m_frame_dim.getSize().getHeight() / m_bin.getY();
+  }
+}
+
+/**
+ * @brief Gets the region of binned pixels to generate, written
+ *contiguously
+ *
+ * @param[out] region  FrameRegion
+ *******************************************************************/
+void FrameBuilder::getFrameRegion(FrameRegion &region) const
+{
+  getBinnedRange(region.bx0, region.bxM, region.by0, region.byM);
+  region.stride = region.bxM - region.bx0;
+}
+
+/**
+ * @brief Calculates the binned box of pixels where a peak is
+ *evaluated, according to the peak cut-off
+ *
+ * @param[in]  peak      GaussPeak at its current position
+ * @param[in]  bx0, bxM  int range of binned columns [bx0, bxM)
+ * @param[in]  by0, byM  int range of binned rows [by0, byM)
+ * @param[out] fp        PeakFootprint clipped to the ranges
+ * @return     false if the footprint is out of the ranges
+ *******************************************************************/
+bool FrameBuilder::getPeakFootprint(const GaussPeak &peak, int bx0, int bxM, int by0, int byM, PeakFootprint &fp) const
+{
+  fp.x_begin = bx0;
+  fp.x_end   = bxM;
+  fp.y_begin = by0;
+  fp.y_end   = byM;
+
+  if (m_peak_cutoff > 0) {
+    double half = m_peak_cutoff * SGM_FWHM * fabs(peak.fwhm);
+    int binX    = m_bin.getX();
+    int binY    = m_bin.getY();
+
+    // Clamp in double before converting, far away peaks may overflow an int
+    fp.x_begin = int(std::max(floor((peak.x0 - half) / binX), double(bx0)));
+    fp.x_end   = int(std::min(floor((peak.x0 + half) / binX) + 1, double(bxM)));
+    fp.y_begin = int(std::max(floor((peak.y0 - half) / binY), double(by0)));
+    fp.y_end   = int(std::min(floor((peak.y0 + half) / binY) + 1, double(byM)));
+  }
+
+  return (fp.x_begin < fp.x_end) && (fp.y_begin < fp.y_end);
+}
+
+FrameBuilder::PeakList FrameBuilder::getGaussPeaksFrom3d(double angle) const
+{
+  PeakList gauss_peaks;
+  PeakList::const_iterator pit, pend            = m_peaks.end();
+  std::vector<double>::const_iterator ait, aend = m_peak_angles.end();
+
+  int rot_y  = (m_rot_axis == RotationY);
+  Size size  = m_frame_dim.getSize();
+  int dim    = rot_y ? size.getWidth() : size.getHeight();
+  int center = dim / 2;
+  for (pit = m_peaks.begin(), ait = m_peak_angles.begin(); (pit != pend) && (ait != aend); ++pit, ++ait) {
+    double rad    = (angle + *ait) * M_PI / 180;
+    double x      = pit->x0;
+    double y      = pit->y0;
+    double *coord = rot_y ? &x : &y;
+    double r      = abs(center - *coord);
+    if (center > *coord) rad += M_PI;
+    *coord = center + int(r * cos(rad));
+    GaussPeak peak(x, y, pit->fwhm, pit->max);
+    gauss_peaks.push_back(peak);
+  }
+
+  return gauss_peaks;
+}
+
+/**
+ * @brief Calculates the summary intensity at certain
  *point
  *
  * @param[in] x  int X-coord
@@ -536,95 +1716,689 @@ FrameBuilder::PeakList FrameBuilder::getGaussPeaksFrom3d(double angle) const
  *******************************************************************/
 double FrameBuilder::dataDiffract(double x, double y) const
 {
-  x -= m_frame_dim.getSize().getWidth() / 2;
-  y -= m_frame_dim.getSize().getHeight() / 2;
-  double r  = sqrt(pow(x, 2.0) + pow(y, 2.0));
-  double w  = (2 * M_PI / 100 * (0.5 + r / 500));
-  double ar = (r >= 300) ? (r - 300) : 0;
-  double a  = exp(-pow(ar / 500, 4.0)) / (r / 5000 + 0.1);
-  return a * pow(cos(r * w), 20.0);
+  x -= m_frame_dim.getSize().getWidth() / 2;
+  y -= m_frame_dim.getSize().getHeight() / 2;
+  double r  = sqrt(pow(x, 2.0) + pow(y, 2.0));
+  double w  = (2 * M_PI / 100 * (0.5 + r / 500));
+  double ar = (r >= 300) ? (r - 300) : 0;
+  double a  = exp(-pow(ar / 500, 4.0)) / (r / 5000 + 0.1);
+  return a * pow(cos(r * w), 20.0);
+}
+
+/**
+ * @brief Calculates the summary intensity of the Gauss
+ *peaks at certain point
+ *
+ * @param[in] peaks  PeakList
+ * @param[in] x      double X-coord
+ * @param[in] y      double Y-coord
+ * @return    intensity  double
+ *******************************************************************/
+double FrameBuilder::dataGauss(const PeakList &peaks, double x, double y) const
+{
+  double val = 0.0;
+  PeakList::const_iterator p;
+
+  for (p = peaks.begin(); p != peaks.end(); ++p) {
+    val += gauss2D(x, y, p->x0, p->y0, p->fwhm, p->max);
+  }
+
+  return val;
+}
+
+// Depth specific store kernels, for the fill templates
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, unsigned char *dst, int n)
+{
+  k.store_u8(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, unsigned short *dst, int n)
+{
+  k.store_u16(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, unsigned int *dst, int n)
+{
+  k.store_u32(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, unsigned long long *dst, int n)
+{
+  k.store_u64(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, signed char *dst, int n)
+{
+  k.store_s8(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, short *dst, int n)
+{
+  k.store_s16(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, int *dst, int n)
+{
+  k.store_s32(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, long long *dst, int n)
+{
+  k.store_s64(src, scale, dst, n);
+}
+
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, float *dst, int n)
+{
+  k.store_f32(src, scale, dst, n);
+}
+
+// The 10, 12, 14 and 24-bit image types, stored unpacked in a 16 or 32-bit word
+template <class T, int bits, bool is_signed>
+struct NBitPixel {
+  T value;
+};
+
+static inline void storeNBits(const FrameKernels &k, const double *src, double scale, double lo, double hi,
+                              unsigned short *dst, int n)
+{
+  k.store_n16(src, scale, lo, hi, dst, n);
+}
+
+static inline void storeNBits(const FrameKernels &k, const double *src, double scale, double lo, double hi,
+                              unsigned int *dst, int n)
+{
+  k.store_n32(src, scale, lo, hi, dst, n);
+}
+
+template <class T, int bits, bool is_signed>
+static inline void storeRow(const FrameKernels &k, const double *src, double scale, NBitPixel<T, bits, is_signed> *dst,
+                            int n)
+{
+  static_assert(sizeof(NBitPixel<T, bits, is_signed>) == sizeof(T), "NBitPixel must be a bare word");
+  const double lo = is_signed ? -double(1 << (bits - 1)) : 0.0;
+  const double hi = is_signed ? double((1 << (bits - 1)) - 1) : double((1 << bits) - 1);
+  storeNBits(k, src, scale, lo, hi, reinterpret_cast<T *>(dst), n);
 }
 
 /**
- * @brief Calculates the summary intensity at certain
- *point
+ * @brief Selects the fill function specialized for the current
+ *image type, FillType, RenderMode and Bin
  *
- * @param[in] x  int X-coord
- * @param[in] y  int Y-coord
- * @return    intensity  double
+ * Called by prepareAcq() and by the setters of these settings, so
+ *that getFrame() does not need to dispatch on them for every frame
  *******************************************************************/
-double FrameBuilder::dataXY(unsigned long frame_nr, const PeakList &peaks, int x, int y) const
+void FrameBuilder::selectFillFunction()
 {
-  double val = 0.0;
-  PeakList::const_iterator p;
-
-  double gx, gy;
-
-  if (m_fill_type == Gauss) {
-    gx = x;
-    gy = y;
-  } else {
-    gx = m_diffract_x + frame_nr * m_diffract_sx;
-    gy = m_diffract_y + frame_nr * m_diffract_sy;
-  }
-
-  for (p = peaks.begin(); p != peaks.end(); ++p) {
-    val += gauss2D(gx, gy, p->x0, p->y0, p->fwhm, p->max);
+  switch (m_frame_dim.getImageType()) {
+  case Bpp8:
+    selectFillFunction<unsigned char>();
+    break;
+  case Bpp8S:
+    selectFillFunction<signed char>();
+    break;
+  case Bpp16:
+    selectFillFunction<unsigned short>();
+    break;
+  case Bpp16S:
+    selectFillFunction<short>();
+    break;
+  case Bpp32:
+    selectFillFunction<unsigned int>();
+    break;
+  case Bpp32S:
+    selectFillFunction<int>();
+    break;
+  case Bpp32F:
+    selectFillFunction<float>();
+    break;
+  case Bpp64:
+    selectFillFunction<unsigned long long>();
+    break;
+  case Bpp64S:
+    selectFillFunction<long long>();
+    break;
+  case Bpp10:
+    selectFillFunction<NBitPixel<unsigned short, 10, false>>();
+    break;
+  case Bpp10S:
+    selectFillFunction<NBitPixel<unsigned short, 10, true>>();
+    break;
+  case Bpp12:
+    selectFillFunction<NBitPixel<unsigned short, 12, false>>();
+    break;
+  case Bpp12S:
+    selectFillFunction<NBitPixel<unsigned short, 12, true>>();
+    break;
+  case Bpp14:
+    selectFillFunction<NBitPixel<unsigned short, 14, false>>();
+    break;
+  case Bpp14S:
+    selectFillFunction<NBitPixel<unsigned short, 14, true>>();
+    break;
+  case Bpp24:
+    selectFillFunction<NBitPixel<unsigned int, 24, false>>();
+    break;
+  case Bpp24S:
+    selectFillFunction<NBitPixel<unsigned int, 24, true>>();
+    break;
+  default:
+    m_fill_function = NULL;
+    m_gaps_function = NULL;
   }
-  val *= (1 + m_grow_factor * frame_nr);
+}
 
-  if (m_fill_type == Diffraction) val *= dataDiffract(x, y);
+/**
+ * @brief Selects the fill functions writing pixels of the given
+ *type
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::selectFillFunction()
+{
+  m_fill_function = getFillFunction<depth>();
+  m_gaps_function = &FrameBuilder::fillGaps<depth>;
+}
 
-  return val;
+/**
+ * @brief Returns the fill function for the given pixel type
+ *
+ * The Reference fills are specialized for bin 1x1, 2x2 and any
+ *other bin (0)
+ *******************************************************************/
+template <class depth>
+FrameBuilder::FillFunction FrameBuilder::getFillFunction() const
+{
+  static const FillFunction reference[2][3] = {
+    {&FrameBuilder::fillReference<depth, Gauss, 0>,
+     &FrameBuilder::fillReference<depth, Gauss, 1>,
+     &FrameBuilder::fillReference<depth, Gauss, 2>},
+    {&FrameBuilder::fillReference<depth, Diffraction, 0>,
+     &FrameBuilder::fillReference<depth, Diffraction, 1>,
+     &FrameBuilder::fillReference<depth, Diffraction, 2>},
+  };
+
+  if (m_fill_type == Empty)
+    return NULL;
+
+  if (m_fill_type == Photons)
+    return &FrameBuilder::fillPhotons<depth>;
+
+  if (m_render_mode != Reference)
+    return (m_fill_type == Gauss) ? &FrameBuilder::fillSeparable<depth> : &FrameBuilder::fillDiffraction<depth>;
+
+  int bin = m_bin.getX();
+  if ((bin != m_bin.getY()) || (bin > 2))
+    bin = 0;
+  return reference[(m_fill_type == Gauss) ? 0 : 1][bin];
 }
 
 /**
  * @brief Calculates and writes the "image" into the
  *buffer
  *
- * This function also applies the "hardware" binning
+ * This function also applies the "hardware" binning. The bin
+ *factor is a compile-time constant unless bin is 0.
+ *
+ * The Diffraction intensity at the source position does not depend
+ *on the pixel, it is evaluated once per frame.
  *
- * @todo Support more depths, not only 1, 2, and 4
- *bytes
  * @param[in] ptr  an (unsigned char) pointer to an
  *allocated buffer
  *******************************************************************/
-template <class depth>
-void FrameBuilder::fillData(unsigned long frame_nr, unsigned char *ptr) const
+template <class depth, FrameBuilder::FillType fill_type, int bin>
+void FrameBuilder::fillReference(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const
 {
-  int x, bx, bx0, bxM, y, by, by0, byM;
-  int binX   = m_bin.getX();
-  int binY   = m_bin.getY();
-  int width  = m_frame_dim.getSize().getWidth();
-  int height = m_frame_dim.getSize().getHeight();
-  depth *p   = (depth *)ptr;
-  double data, max;
-
-  if (!m_roi.isEmpty()) {
-    bx0 = m_roi.getTopLeft().x;
-    bxM = m_roi.getBottomRight().x + 1;
-    by0 = m_roi.getTopLeft().y;
-    byM = m_roi.getBottomRight().y + 1;
-  } else {
-    bx0 = by0 = 0;
-    bxM       = width / binX;
-    byM       = height / binY;
-  }
+  int x, bx, y, by;
+  int bx0  = region.bx0, bxM = region.bxM;
+  int by0  = region.by0, byM = region.byM;
+  int binX = bin ? bin : m_bin.getX();
+  int binY = bin ? bin : m_bin.getY();
+  depth *p = (depth *)ptr;
+  double data;
 
   double rot_angle = m_rot_angle + m_rot_speed * frame_nr;
   PeakList peaks   = getGaussPeaksFrom3d(rot_angle);
+  double scale     = 1 + m_grow_factor * frame_nr;
+
+  double diffract_val = 0.0;
+  if (fill_type == Diffraction) {
+    double gx    = m_diffract_x + frame_nr * m_diffract_sx;
+    double gy    = m_diffract_y + frame_nr * m_diffract_sy;
+    diffract_val = dataGauss(peaks, gx, gy) * scale;
+  }
+
+  bool noise = hasNoise();
 
-  max = (double)((depth)-1);
+#pragma omp parallel for num_threads(getNbWorkers()) private(bx, x, y, data)
   for (by = by0; by < byM; by++) {
+    pinWorker();
+    depth *p_row = p + size_t(by - by0) * region.stride;
     for (bx = bx0; bx < bxM; bx++) {
       data = 0.0;
       for (y = by * binY; y < by * binY + binY; y++) {
         for (x = bx * binX; x < bx * binX + binX; x++) {
-          data += dataXY(frame_nr, peaks, x, y);
+          if (fill_type == Gauss)
+            data += dataGauss(peaks, x, y) * scale;
+          else
+            data += diffract_val * dataDiffract(x, y);
+        }
+      }
+      if (noise) noiseRow(frame_nr, bx, by, &data, 1.0, &data, 1);
+      storeRow(*m_kernels, &data, 1.0, p_row++, 1);
+    }
+  }
+}
+
+/**
+ * @brief Calculates and writes the Gauss "image" into the
+ *buffer using the separability of the peaks
+ *
+ * Each peak is the outer product of a binned X profile and a
+ *binned Y profile (the latter scaled by the peak maximum and
+ *the grow factor), so a pixel costs one multiply-add per peak
+ *instead of one exp() per peak and per sub-pixel.
+ *
+ * Peaks are only evaluated inside their footprint (see
+ *setPeakCutoff()), the tiles outside of any footprint are
+ *cleared, so the cost is proportional to the peak area.
+ *
+ * The frame is rendered by tiles (see setTileSize()) spread over
+ *the threads: the peaks of a tile and the tile itself stay in
+ *cache while being accumulated, then each tile row is written
+ *straight to the frame.
+ *
+ * Without cut-off, the result matches fillReference() up to
+ *floating point rounding, i.e. pixels may differ by at most 1 LSB
+ *where the exact value is close to an integer. The cut-off adds
+ *at most getPeakCutoffError() to that.
+ *
+ * If the peaks do not rotate, the frames only differ by the grow
+ *scale and are rendered from the base frame cached by
+ *prepareAcq() (see buildBaseFrame()).
+ *
+ * @param[in] ptr  an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::fillSeparable(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const
+{
+  double scale = 1 + m_grow_factor * frame_nr;
+
+  // Scale the cached frame, if prepareAcq() built it
+  BaseFrame base = atomic_load(&m_base_frame);
+  if (base) {
+    fillScaled<depth>(*base, frame_nr, scale, region, ptr);
+    return;
+  }
+
+  int bx0     = region.bx0, bxM = region.bxM;
+  int by0     = region.by0, byM = region.byM;
+  int nb_cols = bxM - bx0;
+
+  PeakProfiles profiles;
+  getPeakProfiles(m_rot_angle + m_rot_speed * frame_nr, scale, region, profiles);
+  bool noise = hasNoise();
+
+  int tile_width  = std::min(m_tile_width, nb_cols);
+  int tile_height = std::min(m_tile_height, byM - by0);
+  int nb_tiles_x  = (nb_cols + tile_width - 1) / tile_width;
+  int nb_tiles_y  = (byM - by0 + tile_height - 1) / tile_height;
+  int nb_tiles    = nb_tiles_x * nb_tiles_y;
+
+#pragma omp parallel num_threads(getNbWorkers())
+  {
+    pinWorker();
+
+    vector<double> tile(size_t(tile_width) * tile_height);
+    vector<int> peaks;
+#pragma omp for schedule(dynamic)
+    for (int t = 0; t < nb_tiles; t++) {
+      int tx0    = bx0 + (t % nb_tiles_x) * tile_width;
+      int ty0    = by0 + (t / nb_tiles_x) * tile_height;
+      int width  = std::min(tile_width, bxM - tx0);
+      int height = std::min(tile_height, byM - ty0);
+
+      bool empty = !gaussTile(profiles, tx0, ty0, width, height, peaks, &tile[0], tile_width);
+      if (empty && noise)
+        fill(tile.begin(), tile.end(), 0.0);
+
+      // Each row of the tile goes straight to the frame
+      for (int y = 0; y < height; y++) {
+        depth *p  = (depth *)ptr + size_t(ty0 + y - by0) * region.stride + (tx0 - bx0);
+        double *r = &tile[size_t(y) * tile_width];
+        if (empty && !noise) {
+          memset(p, 0, width * sizeof(depth));
+          continue;
         }
+        if (noise)
+          noiseRow(frame_nr, tx0, ty0 + y, r, 1.0, r, width);
+        storeRow(*m_kernels, r, 1.0, p, width);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Calculates and writes the Diffraction "image" into the
+ *buffer with the vectorized kernels
+ *
+ * The Gauss sum is evaluated at the source position, so it is
+ *the same for all the pixels of a frame and the frame is the
+ *Diffraction pattern times a scale. The pattern is cached by
+ *prepareAcq() (see buildBaseFrame()), otherwise it is computed
+ *on the fly.
+ *
+ * @param[in] ptr  an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::fillDiffraction(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const
+{
+  int bx0     = region.bx0;
+  int by0     = region.by0, byM = region.byM;
+  int nb_cols = region.bxM - bx0;
+
+  double rot_angle = m_rot_angle + m_rot_speed * frame_nr;
+  PeakList peaks   = getGaussPeaksFrom3d(rot_angle);
+  double gx        = m_diffract_x + frame_nr * m_diffract_sx;
+  double gy        = m_diffract_y + frame_nr * m_diffract_sy;
+
+  double scale = 0.0;
+  PeakList::const_iterator it;
+  for (it = peaks.begin(); it != peaks.end(); ++it)
+    scale += gauss2D(gx, gy, it->x0, it->y0, it->fwhm, it->max);
+  scale *= (1 + m_grow_factor * frame_nr);
+
+  // Scale the cached pattern, if prepareAcq() built it
+  BaseFrame base = atomic_load(&m_base_frame);
+  if (base) {
+    fillScaled<depth>(*base, frame_nr, scale, region, ptr);
+    return;
+  }
+
+  bool noise = hasNoise();
+
+#pragma omp parallel num_threads(getNbWorkers())
+  {
+    pinWorker();
+
+    vector<double> row(nb_cols);
+#pragma omp for schedule(static)
+    for (int by = by0; by < byM; by++) {
+      depth *p = (depth *)ptr + size_t(by - by0) * region.stride;
+      diffractRow(bx0, by, nb_cols, &row[0]);
+      if (noise) {
+        noiseRow(frame_nr, bx0, by, &row[0], scale, &row[0], nb_cols);
+        storeRow(*m_kernels, &row[0], 1.0, p, nb_cols);
+      } else {
+        storeRow(*m_kernels, &row[0], scale, p, nb_cols);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Writes the cached base frame times a scale into the
+ *buffer
+ *
+ * A single vectorized pass per row: scale, saturate and convert
+ *to the output depth (plus the noise, if any).
+ *
+ * @param[in] base    the frame built by buildBaseFrame()
+ * @param[in] scale   double the frame scale
+ * @param[in] region  FrameRegion to write
+ * @param[in] ptr     an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::fillScaled(const vector<double> &base, unsigned long frame_nr, double scale,
+                              const FrameRegion &region, unsigned char *ptr) const
+{
+  int bx0     = region.bx0;
+  int by0     = region.by0, byM = region.byM;
+  int nb_cols = region.bxM - bx0;
+  bool noise  = hasNoise();
+
+  // The base frame covers the whole binned range
+  FrameRegion frame;
+  getFrameRegion(frame);
+
+#pragma omp parallel num_threads(getNbWorkers())
+  {
+    pinWorker();
+
+    vector<double> row(noise ? nb_cols : 0);
+#pragma omp for schedule(static)
+    for (int by = by0; by < byM; by++) {
+      const double *src = &base[size_t(by - frame.by0) * frame.stride + (bx0 - frame.bx0)];
+      depth *p          = (depth *)ptr + size_t(by - by0) * region.stride;
+      if (noise) {
+        noiseRow(frame_nr, bx0, by, src, scale, &row[0], nb_cols);
+        storeRow(*m_kernels, &row[0], 1.0, p, nb_cols);
+      } else {
+        storeRow(*m_kernels, src, scale, p, nb_cols);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Samples the photons of the Gauss peaks hitting a region
+ *of the frame
+ *
+ * Each peak emits a Poisson number of photons, of mean its volume
+ *(max * 2 pi sigma^2 times the grow scale), spread along the peak
+ *profile, the mean count of a pixel being the Sampled Gauss frame.
+ *The peaks whose footprint misses the region are skipped, so that
+ *the cost is proportional to the number of photons of the peaks
+ *around the region, not to its size. The random numbers only
+ *depend on (seed, frame_nr, peak, photon), so that a photon is
+ *the same whatever the region.
+ *
+ * @param[in]  frame_nr  unsigned long frame number
+ * @param[in]  region    FrameRegion, its stride is not used
+ * @param[out] photons   PhotonList of binned frame coordinates
+ *******************************************************************/
+void FrameBuilder::samplePhotons(unsigned long frame_nr, const FrameRegion &region, PhotonList &photons) const
+{
+  static const int BLOCK = 256;
+
+  double scale   = 1 + m_grow_factor * frame_nr;
+  PeakList peaks = getGaussPeaksFrom3d(m_rot_angle + m_rot_speed * frame_nr);
+  int binX       = m_bin.getX();
+  int binY       = m_bin.getY();
+  int width      = m_frame_dim.getSize().getWidth();
+  int height     = m_frame_dim.getSize().getHeight();
+
+  // The photon numbers of all the peaks at once
+  int nb_peaks = peaks.size();
+  vector<double> peak_u(nb_peaks), peak_z(nb_peaks), peak_z2(nb_peaks), peak_photons(nb_peaks);
+  for (int i = 0; i < nb_peaks; i++) {
+    double sigma    = SGM_FWHM * fabs(peaks[i].fwhm);
+    peak_photons[i] = peaks[i].max * scale * 2 * M_PI * sigma * sigma;
+  }
+  if (nb_peaks > 0) {
+    m_kernels->random_row(m_noise.seed, FrameKernels::PEAK_STREAM, frame_nr, 0, &peak_u[0], &peak_z[0], &peak_z2[0],
+                          nb_peaks);
+    m_kernels->poisson_row(&peak_photons[0], &peak_u[0], &peak_z[0], &peak_photons[0], nb_peaks);
+  }
+
+  double u[BLOCK], zx[BLOCK], zy[BLOCK];
+  for (int i = 0; i < nb_peaks; i++) {
+    const GaussPeak &peak = peaks[i];
+    PeakFootprint fp;
+    if (!getPeakFootprint(peak, region.bx0, region.bxM, region.by0, region.byM, fp))
+      continue;
+
+    double sigma                  = SGM_FWHM * fabs(peak.fwhm);
+    unsigned long long nb_photons = (unsigned long long)peak_photons[i];
+
+    // The photons of a peak are counted from (peak << 32)
+    unsigned long long counter0 = (unsigned long long)i << 32;
+    for (unsigned long long j0 = 0; j0 < nb_photons; j0 += BLOCK) {
+      int nb = int(std::min((unsigned long long)BLOCK, nb_photons - j0));
+      m_kernels->random_row(m_noise.seed, FrameKernels::PHOTON_STREAM, frame_nr, counter0 + j0, u, zx, zy, nb);
+      for (int j = 0; j < nb; j++) {
+        // Pixel x covers [x - 0.5, x + 0.5), as the Gauss frames are sampled at the pixel centers
+        double x = floor(peak.x0 + sigma * zx[j] + 0.5);
+        double y = floor(peak.y0 + sigma * zy[j] + 0.5);
+        if ((x < 0) || (x >= width) || (y < 0) || (y >= height))
+          continue;
+        PhotonEvent photon;
+        photon.x = int(x) / binX;
+        photon.y = int(y) / binY;
+        if ((photon.x >= region.bx0) && (photon.x < region.bxM) && (photon.y >= region.by0) &&
+            (photon.y < region.byM))
+          photons.push_back(photon);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Writes the photon counts of the Photons fill type into
+ *the buffer
+ *
+ * The region is cleared, then only the pixels hit by photons are
+ *written. The noise settings do not apply, the photon counting
+ *being the shot noise.
+ *
+ * @param[in] ptr  an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::fillPhotons(unsigned long frame_nr, const FrameRegion &region, unsigned char *ptr) const
+{
+  int bx0     = region.bx0;
+  int by0     = region.by0, byM = region.byM;
+  int nb_cols = region.bxM - bx0;
+
+  if (region.stride == size_t(nb_cols))
+    memset(ptr, 0, size_t(byM - by0) * nb_cols * sizeof(depth));
+  else
+    for (int by = by0; by < byM; by++)
+      memset((depth *)ptr + size_t(by - by0) * region.stride, 0, nb_cols * sizeof(depth));
+
+  PhotonList photons;
+  samplePhotons(frame_nr, region, photons);
+
+  // Sorted, the photons hitting the same pixel are counted at once
+  vector<size_t> offsets(photons.size());
+  for (size_t i = 0; i < photons.size(); i++)
+    offsets[i] = size_t(photons[i].y - by0) * region.stride + (photons[i].x - bx0);
+  sort(offsets.begin(), offsets.end());
+
+  depth *p = (depth *)ptr;
+  for (size_t i = 0; i < offsets.size();) {
+    size_t end = i + 1;
+    while ((end < offsets.size()) && (offsets[end] == offsets[i]))
+      end++;
+    double count = double(end - i);
+    storeRow(*m_kernels, &count, 1.0, p + offsets[i], 1);
+    i = end;
+  }
+}
+
+/**
+ * @brief Renders each module of the frame independently, then
+ *fills the gaps
+ *
+ * The modules are split over the threads if there are enough of
+ *them, otherwise each module is split over the threads.
+ *
+ * @param[in] ptr  an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+void FrameBuilder::fillModules(unsigned long frame_nr, unsigned char *ptr) const
+{
+  int bx0, bxM, by0, byM;
+  getBinnedRange(bx0, bxM, by0, byM);
+
+  int depth         = m_frame_dim.getDepth();
+  int module_width  = m_module_size.getWidth() / m_bin.getX();
+  int module_height = m_module_size.getHeight() / m_bin.getY();
+  int pitch_x       = module_width + m_gap_size.getWidth() / m_bin.getX();
+  int pitch_y       = module_height + m_gap_size.getHeight() / m_bin.getY();
+
+  vector<FrameRegion> regions;
+  vector<unsigned char *> ptrs;
+  for (int my = 0; my < m_nb_modules_y; my++) {
+    for (int mx = 0; mx < m_nb_modules_x; mx++) {
+      FrameRegion region;
+      region.bx0 = std::max(mx * pitch_x, bx0);
+      region.bxM = std::min(mx * pitch_x + module_width, bxM);
+      region.by0 = std::max(my * pitch_y, by0);
+      region.byM = std::min(my * pitch_y + module_height, byM);
+      if ((region.bx0 >= region.bxM) || (region.by0 >= region.byM))
+        continue;
+
+      // No RoI in module order
+      size_t offset;
+      if (m_module_order) {
+        region.stride = module_width;
+        offset        = size_t(my * m_nb_modules_x + mx) * module_height * module_width;
+      } else {
+        region.stride = bxM - bx0;
+        offset        = size_t(region.by0 - by0) * region.stride + (region.bx0 - bx0);
       }
-      if (data > max) data = max; // ???
-      *p++ = (depth)data;
+      regions.push_back(region);
+      ptrs.push_back(ptr + offset * depth);
+    }
+  }
+
+  int nb_regions = regions.size();
+  int nb_workers = getNbWorkers();
+  if (nb_regions >= nb_workers) {
+#pragma omp parallel for num_threads(nb_workers) schedule(dynamic)
+    for (int i = 0; i < nb_regions; i++) {
+      pinWorker();
+      (this->*m_fill_function)(frame_nr, regions[i], ptrs[i]);
+    }
+  } else {
+    for (int i = 0; i < nb_regions; i++)
+      (this->*m_fill_function)(frame_nr, regions[i], ptrs[i]);
+  }
+
+  if (m_module_order)
+    return;
+
+  (this->*m_gaps_function)(ptr);
+}
+
+/**
+ * @brief Sets the gap pixels of an assembled frame to the gap
+ *value
+ *
+ * @param[in] ptr  an (unsigned char) pointer to an
+ *allocated buffer
+ *******************************************************************/
+template <class depth>
+void FrameBuilder::fillGaps(unsigned char *ptr) const
+{
+  int bx0, bxM, by0, byM;
+  getBinnedRange(bx0, bxM, by0, byM);
+  int nb_cols = bxM - bx0;
+
+  int module_width  = m_module_size.getWidth() / m_bin.getX();
+  int module_height = m_module_size.getHeight() / m_bin.getY();
+  int gap_width     = m_gap_size.getWidth() / m_bin.getX();
+  int pitch_x       = module_width + gap_width;
+  int pitch_y       = module_height + m_gap_size.getHeight() / m_bin.getY();
+
+  // Saturated and rounded like the pixels
+  depth value;
+  storeRow(*m_kernels, &m_gap_value, 1.0, &value, 1);
+
+  for (int by = by0; by < byM; by++) {
+    depth *p = (depth *)ptr + size_t(by - by0) * nb_cols;
+    if ((by % pitch_y) >= module_height) {
+      std::fill(p, p + nb_cols, value);
+      continue;
+    }
+    for (int mx = 0; mx < m_nb_modules_x - 1; mx++) {
+      int xb = std::max(mx * pitch_x + module_width, bx0);
+      int xe = std::min(mx * pitch_x + pitch_x, bxM);
+      if (xb < xe)
+        std::fill(p + (xb - bx0), p + (xe - bx0), value);
     }
   }
 }
@@ -635,8 +2409,7 @@ void FrameBuilder::fillData(unsigned long frame_nr, unsigned char *ptr) const
  * @param[in] ptr  an (unsigned char) pointer to an
  *allocated buffer
  *
- * @exception lima::Exception  The image depth is not
- *1,2 or 4
+ * @exception lima::Exception  The image type is not supported
  *******************************************************************/
 bool FrameBuilder::getFrame(unsigned long frame_nr, unsigned char *ptr)
 {
@@ -644,19 +2417,255 @@ bool FrameBuilder::getFrame(unsigned long frame_nr, unsigned char *ptr)
     return true;
   }
 
-  switch (m_frame_dim.getDepth()) {
-  case 1:
-    fillData<unsigned char>(frame_nr, ptr);
-    break;
-  case 2:
-    fillData<unsigned short>(frame_nr, ptr);
-    break;
-  case 4:
-    fillData<unsigned int>(frame_nr, ptr);
-    break;
-  default:
-    throw LIMA_HW_EXC(NotSupported, "Invalid depth");
+  if (!m_fill_function)
+    throw LIMA_HW_EXC(NotSupported, "Image type not supported");
+
+  // The noise and the photons make every frame different
+  size_t cache_size;
+  m_frame_cache.getMaxSize(cache_size);
+  bool cached = (cache_size > 0) && isFrameRepeating();
+
+  FrameCache::Key key;
+  size_t mem_size = 0;
+  if (cached) {
+    FrameDim frame_dim;
+    getEffectiveFrameDim(frame_dim);
+    mem_size = getFrameMemSize(frame_dim);
+    getFrameKey(frame_nr, key);
+    if (m_frame_cache.get(key, ptr, mem_size))
+      return true;
+  }
+
+  if (hasModules()) {
+    fillModules(frame_nr, ptr);
+  } else {
+    FrameRegion region;
+    getFrameRegion(region);
+    (this->*m_fill_function)(frame_nr, region, ptr);
   }
 
+  if (cached)
+    m_frame_cache.put(key, ptr, mem_size);
+
   return true;
 }
+
+/**
+ * @brief Gets the photons of a frame of the Photons fill type, as
+ *written by getFrame()
+ *
+ * The cost is proportional to the number of photons, not to the
+ *frame size. The photons hitting the gaps between the modules are
+ *dropped, the others are in the coordinates of the binned and
+ *RoI-cropped frame, or of the stacked modules in module order.
+ *
+ * @param[in]  frame_nr  unsigned long frame number
+ * @param[out] photons   PhotonList, a pixel hit by n photons being
+ *listed n times
+ *
+ * @exception lima::Exception  The fill type is not Photons
+ *******************************************************************/
+void FrameBuilder::getPhotonEvents(unsigned long frame_nr, PhotonList &photons) const
+{
+  if (m_fill_type != Photons)
+    throw LIMA_HW_EXC(InvalidValue, "Fill type is not Photons");
+
+  FrameRegion region;
+  getFrameRegion(region);
+
+  photons.clear();
+  samplePhotons(frame_nr, region, photons);
+
+  int module_width  = m_module_size.getWidth() / m_bin.getX();
+  int module_height = m_module_size.getHeight() / m_bin.getY();
+  int pitch_x       = module_width + m_gap_size.getWidth() / m_bin.getX();
+  int pitch_y       = module_height + m_gap_size.getHeight() / m_bin.getY();
+  bool modules      = hasModules();
+
+  PhotonList::iterator out = photons.begin();
+  for (PhotonList::const_iterator it = photons.begin(); it != photons.end(); ++it) {
+    if (modules && (((it->x % pitch_x) >= module_width) || ((it->y % pitch_y) >= module_height)))
+      continue;
+    if (m_module_order) {
+      // No RoI in module order
+      int module = (it->y / pitch_y) * m_nb_modules_x + (it->x / pitch_x);
+      out->x     = it->x % pitch_x;
+      out->y     = module * module_height + (it->y % pitch_y);
+    } else {
+      out->x = it->x - region.bx0;
+      out->y = it->y - region.by0;
+    }
+    ++out;
+  }
+  photons.erase(out, photons.end());
+}
+
+/**
+ * @brief Gets the parameters of a frame that change with the frame
+ *number, and its geometry
+ *
+ * @param[in]  frame_nr  unsigned long frame number
+ * @param[out] key       FrameCache::Key
+ *******************************************************************/
+void FrameBuilder::getFrameKey(unsigned long frame_nr, FrameCache::Key &key) const
+{
+  // Equivalent angles must give the same key despite the rounding
+  // errors of m_rot_speed * frame_nr
+  double rot_angle = fmod(m_rot_angle + m_rot_speed * frame_nr, 360);
+  if (rot_angle < 0)
+    rot_angle += 360;
+  rot_angle = round(rot_angle * 1e9) / 1e9;
+  if (rot_angle >= 360)
+    rot_angle = 0;
+
+  key.rot_angle  = rot_angle;
+  key.diffract_x = 0;
+  key.diffract_y = 0;
+  if (m_fill_type == Diffraction) {
+    key.diffract_x = m_diffract_x + frame_nr * m_diffract_sx;
+    key.diffract_y = m_diffract_y + frame_nr * m_diffract_sy;
+  }
+  key.scale = 1 + m_grow_factor * frame_nr;
+
+  FrameDim frame_dim;
+  getEffectiveFrameDim(frame_dim);
+  key.width      = frame_dim.getSize().getWidth();
+  key.height     = frame_dim.getSize().getHeight();
+  key.image_type = frame_dim.getImageType();
+}
+
+/**
+ * @brief Returns true if a frame may be generated again later in
+ *the sequence, and is thus worth caching
+ *
+ * The grow factor and the Diffraction speed make every frame
+ *different, as do the noise and the photons.
+ *******************************************************************/
+bool FrameBuilder::isFrameRepeating() const
+{
+  if (hasNoise() || (m_fill_type == Photons) || (m_grow_factor != 0))
+    return false;
+  return (m_fill_type != Diffraction) || ((m_diffract_sx == 0) && (m_diffract_sy == 0));
+}
+
+/**
+ * @brief Returns true if the frame is made of several modules
+ *******************************************************************/
+bool FrameBuilder::hasModules() const
+{
+  return (m_nb_modules_x * m_nb_modules_y) > 1;
+}
+
+/// The largest base frame cached by prepareAcq(), 64 Mpixel
+static const size_t MAX_BASE_FRAME_SIZE = size_t(512) << 20;
+
+/**
+ * @brief Prepares the generation of the frames
+ *
+ * Selects the fill function and builds the frame-invariant
+ *base frame if possible
+ *******************************************************************/
+void FrameBuilder::prepareAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  selectFillFunction();
+  m_frame_cache.resetStats();
+
+  if ((m_render_mode == Sprite) && (m_fill_type == Gauss) && (m_peak_cutoff > 0) && !atomic_load(&m_sprites))
+    buildSprites();
+
+  // The base frame is made of doubles, i.e. 2 to 8 times the frame
+  // size: beyond 64 Mpixel the frames are computed from scratch
+  int bx0, bxM, by0, byM;
+  getBinnedRange(bx0, bxM, by0, byM);
+  size_t base_size = size_t(bxM - bx0) * size_t(byM - by0) * sizeof(double);
+
+  if ((m_render_mode != Reference) && isBaseFrameStill() && (base_size <= MAX_BASE_FRAME_SIZE) &&
+      !atomic_load(&m_base_frame))
+    buildBaseFrame();
+}
+
+/**
+ * @brief Returns true if the frames only differ by a scale
+ *
+ * A Diffraction frame is always the Diffraction pattern times a
+ *scale. Gauss frames are the same peaks times the grow scale if
+ *they do not rotate.
+ *******************************************************************/
+bool FrameBuilder::isBaseFrameStill() const
+{
+  if (m_fill_type == Diffraction)
+    return true;
+  return (m_fill_type == Gauss) && (m_rot_speed == 0);
+}
+
+/**
+ * @brief Computes the binned and RoI-cropped base frame: the
+ *Diffraction pattern, or the Gauss peaks of frame 0 without the
+ *grow factor
+ *
+ * The frames are then rendered by fillScaled(), for the cost of
+ *one pass over the frame.
+ *******************************************************************/
+void FrameBuilder::buildBaseFrame()
+{
+  DEB_MEMBER_FUNCT();
+
+  int bx0, bxM, by0, byM;
+  getBinnedRange(bx0, bxM, by0, byM);
+  int nb_cols = bxM - bx0;
+
+  shared_ptr<vector<double> > base = make_shared<vector<double> >(size_t(byM - by0) * nb_cols);
+
+  if (m_fill_type == Gauss) {
+    FrameRegion region;
+    getFrameRegion(region);
+    PeakProfiles profiles;
+    getPeakProfiles(m_rot_angle, 1.0, region, profiles);
+
+    // The tiles are accumulated in place
+    int nb_tiles_x = (nb_cols + m_tile_width - 1) / m_tile_width;
+    int nb_tiles_y = (byM - by0 + m_tile_height - 1) / m_tile_height;
+    int nb_tiles   = nb_tiles_x * nb_tiles_y;
+
+#pragma omp parallel num_threads(getNbWorkers())
+    {
+      pinWorker();
+
+      vector<int> peaks;
+#pragma omp for schedule(dynamic)
+      for (int t = 0; t < nb_tiles; t++) {
+        int tx0    = bx0 + (t % nb_tiles_x) * m_tile_width;
+        int ty0    = by0 + (t / nb_tiles_x) * m_tile_height;
+        int width  = std::min(m_tile_width, bxM - tx0);
+        int height = std::min(m_tile_height, byM - ty0);
+        double *tile = &(*base)[size_t(ty0 - by0) * nb_cols + (tx0 - bx0)];
+        gaussTile(profiles, tx0, ty0, width, height, peaks, tile, nb_cols);
+      }
+    }
+  } else {
+#pragma omp parallel for num_threads(getNbWorkers()) schedule(static)
+    for (int by = by0; by < byM; by++) {
+      pinWorker();
+      diffractRow(bx0, by, nb_cols, &(*base)[size_t(by - by0) * nb_cols]);
+    }
+  }
+
+  atomic_store(&m_base_frame, BaseFrame(base));
+
+  DEB_TRACE() << "Base frame cached: " << DEB_VAR3(m_fill_type, nb_cols, byM - by0);
+}
+
+/**
+ * @brief Releases the cached base frame, it is rebuilt by the
+ *next prepareAcq()
+ *
+ * The frames being generated keep their reference to it, the next
+ *ones are computed from scratch.
+ *******************************************************************/
+void FrameBuilder::invalidateBaseFrame()
+{
+  atomic_store(&m_base_frame, BaseFrame());
+}
+
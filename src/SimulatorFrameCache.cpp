@@ -0,0 +1,180 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <cstring>
+#include <tuple>
+
+#include "simulator/SimulatorFrameCache.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+using namespace std;
+
+bool FrameCache::Key::operator<(const Key &o) const
+{
+  return tie(rot_angle, diffract_x, diffract_y, scale, width, height, image_type) <
+         tie(o.rot_angle, o.diffract_x, o.diffract_y, o.scale, o.width, o.height, o.image_type);
+}
+
+FrameCache::FrameCache() : m_max_size(0), m_size(0), m_hits(0), m_misses(0) {}
+
+FrameCache::FrameCache(const FrameCache &o) : m_size(0), m_hits(0), m_misses(0)
+{
+  o.getMaxSize(m_max_size);
+}
+
+FrameCache &FrameCache::operator=(const FrameCache &o)
+{
+  if (this != &o) {
+    size_t max_size;
+    o.getMaxSize(max_size);
+    clear();
+    resetStats();
+    setMaxSize(max_size);
+  }
+  return *this;
+}
+
+/**
+ * @brief Gets the memory budget of the cache
+ *
+ * @param[out] max_size  size_t in bytes, 0 if disabled
+ *******************************************************************/
+void FrameCache::getMaxSize(size_t &max_size) const
+{
+  lock_guard<mutex> lock(m_mutex);
+  max_size = m_max_size;
+}
+
+/**
+ * @brief Sets the memory budget of the cache, evicting the least
+ *recently used frames beyond it
+ *
+ * @param[in] max_size  size_t in bytes, 0 disables the cache
+ *******************************************************************/
+void FrameCache::setMaxSize(size_t max_size)
+{
+  lock_guard<mutex> lock(m_mutex);
+  m_max_size = max_size;
+  evict(m_max_size);
+}
+
+/**
+ * @brief Gets the number of frames found and not found in the cache
+ *since the last resetStats()
+ *
+ * @param[out] hits, misses  unsigned long
+ *******************************************************************/
+void FrameCache::getStats(unsigned long &hits, unsigned long &misses) const
+{
+  lock_guard<mutex> lock(m_mutex);
+  hits   = m_hits;
+  misses = m_misses;
+}
+
+/**
+ * @brief Resets the hit and miss counters
+ *******************************************************************/
+void FrameCache::resetStats()
+{
+  lock_guard<mutex> lock(m_mutex);
+  m_hits   = 0;
+  m_misses = 0;
+}
+
+/**
+ * @brief Copies a cached frame into the buffer
+ *
+ * @param[in] key   Key of the frame
+ * @param[in] ptr   an (unsigned char) pointer to an
+ *allocated buffer
+ * @param[in] size  size_t of the frame in bytes
+ *
+ * @return true if the frame was cached, ptr is untouched otherwise
+ *******************************************************************/
+bool FrameCache::get(const Key &key, unsigned char *ptr, size_t size)
+{
+  Frame frame;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    map<Key, FrameList::iterator>::iterator it = m_index.find(key);
+    if ((it == m_index.end()) || (it->second->second->size() != size)) {
+      m_misses++;
+      return false;
+    }
+    m_hits++;
+    m_frames.splice(m_frames.begin(), m_frames, it->second);
+    frame = it->second->second;
+  }
+
+  memcpy(ptr, frame->data(), size);
+  return true;
+}
+
+/**
+ * @brief Caches a copy of a frame, if it fits in the memory budget
+ *
+ * @param[in] key   Key of the frame
+ * @param[in] ptr   the frame
+ * @param[in] size  size_t of the frame in bytes
+ *******************************************************************/
+void FrameCache::put(const Key &key, const unsigned char *ptr, size_t size)
+{
+  size_t max_size;
+  getMaxSize(max_size);
+  if (size > max_size)
+    return;
+
+  Frame frame = make_shared<const vector<unsigned char>>(ptr, ptr + size);
+
+  lock_guard<mutex> lock(m_mutex);
+  // Another thread may have rendered the same frame
+  if (m_index.count(key) || (size > m_max_size))
+    return;
+
+  evict(m_max_size - size);
+  m_frames.push_front(make_pair(key, frame));
+  m_index[key] = m_frames.begin();
+  m_size += size;
+}
+
+/**
+ * @brief Releases all the cached frames
+ *******************************************************************/
+void FrameCache::clear()
+{
+  lock_guard<mutex> lock(m_mutex);
+  evict(0);
+}
+
+/**
+ * @brief Releases the least recently used frames until the cache
+ *size is below max_size, the mutex being locked
+ *******************************************************************/
+void FrameCache::evict(size_t max_size)
+{
+  while (m_size > max_size) {
+    m_size -= m_frames.back().second->size();
+    m_index.erase(m_frames.back().first);
+    m_frames.pop_back();
+  }
+}
@@ -0,0 +1,146 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#include "lima/Exceptions.h"
+
+#include "simulator/SimulatorFrameKernels.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+// The vectorized variants rely on the GCC / Clang target attributes, any other
+// compiler (or architecture) only gets the Scalar kernels
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SIMULATOR_KERNELS_X86
+#endif
+
+namespace scalar {
+#define KERNELS_EXACT
+#define KERNELS_INSTRUCTION_SET FrameKernels::Scalar
+#include "SimulatorFrameKernelsImpl.h"
+#undef KERNELS_INSTRUCTION_SET
+#undef KERNELS_EXACT
+} // namespace scalar
+
+#if defined(SIMULATOR_KERNELS_X86)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1,sse4.2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1,sse4.2")
+#endif
+namespace sse4 {
+#define KERNELS_INSTRUCTION_SET FrameKernels::SSE4
+#include "SimulatorFrameKernelsImpl.h"
+#undef KERNELS_INSTRUCTION_SET
+} // namespace sse4
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace avx2 {
+#define KERNELS_INSTRUCTION_SET FrameKernels::AVX2
+#include "SimulatorFrameKernelsImpl.h"
+#undef KERNELS_INSTRUCTION_SET
+} // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512dq,avx512bw,avx512vl"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512dq,avx512bw,avx512vl")
+#endif
+namespace avx512 {
+#define KERNELS_INSTRUCTION_SET FrameKernels::AVX512
+#include "SimulatorFrameKernelsImpl.h"
+#undef KERNELS_INSTRUCTION_SET
+} // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // SIMULATOR_KERNELS_X86
+
+/**
+ * @brief Returns the kernels for the given instruction set
+ *
+ * @exception lima::Exception  The instruction set is not
+ *supported by the build or by the CPU
+ *******************************************************************/
+const FrameKernels &FrameKernels::get(InstructionSet instruction_set)
+{
+  if (instruction_set > getCpuInstructionSet())
+    throw LIMA_HW_EXC(NotSupported, "Instruction set not supported by the CPU");
+
+  switch (instruction_set) {
+#if defined(SIMULATOR_KERNELS_X86)
+  case SSE4:
+    return sse4::kernels;
+  case AVX2:
+    return avx2::kernels;
+  case AVX512:
+    return avx512::kernels;
+#endif
+  default:
+    return scalar::kernels;
+  }
+}
+
+/**
+ * @brief Returns the best instruction set supported by both
+ *the build and the CPU (and the OS, for the AVX registers)
+ *******************************************************************/
+FrameKernels::InstructionSet FrameKernels::getCpuInstructionSet()
+{
+#if defined(SIMULATOR_KERNELS_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl"))
+    return AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return AVX2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return SSE4;
+#endif
+  return Scalar;
+}
@@ -0,0 +1,651 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Kernel bodies, included once per instruction set by SimulatorFrameKernels.cpp
+// inside a dedicated namespace. The loops are written so that the compiler can
+// vectorize them for the target of the enclosing namespace: no libm calls
+// (unless KERNELS_EXACT is defined) and no data dependent branches. The one
+// exception is gaussIntegral(), which calls erf() once per binned pixel.
+
+#if defined(KERNELS_EXACT)
+
+static inline double kernelExp(double x)
+{
+  return std::exp(x);
+}
+
+static inline double kernelCos(double x)
+{
+  return std::cos(x);
+}
+
+static inline double kernelLog(double x)
+{
+  return std::log(x);
+}
+
+#else // KERNELS_EXACT
+
+static const double ROUND_MAGIC = 6755399441055744.0; // 1.5 * 2^52
+
+static inline double bitsToDouble(uint64_t u)
+{
+  double d;
+  std::memcpy(&d, &u, sizeof(d));
+  return d;
+}
+
+static inline uint64_t doubleToBits(double d)
+{
+  uint64_t u;
+  std::memcpy(&u, &d, sizeof(u));
+  return u;
+}
+
+/// exp(x) for x <= 0: x = n ln2 + r, |r| <= ln2 / 2, exp(x) = 2^n exp(r)
+static inline double kernelExp(double x)
+{
+  static const double LN2_HI = 6.93147180369123816490e-01;
+  static const double LN2_LO = 1.90821492927058770002e-10;
+
+  x        = (x < -708.0) ? -708.0 : x;
+  double t = x * 1.44269504088896340736 + ROUND_MAGIC;
+  double n = t - ROUND_MAGIC;
+  double r = (x - n * LN2_HI) - n * LN2_LO;
+
+  // Taylor expansion, the first neglected term is below 6e-15
+  double p = 1.0 / 39916800;
+  p        = p * r + 1.0 / 3628800;
+  p        = p * r + 1.0 / 362880;
+  p        = p * r + 1.0 / 40320;
+  p        = p * r + 1.0 / 5040;
+  p        = p * r + 1.0 / 720;
+  p        = p * r + 1.0 / 120;
+  p        = p * r + 1.0 / 24;
+  p        = p * r + 1.0 / 6;
+  p        = p * r + 0.5;
+  p        = p * r + 1.0;
+  p        = p * r + 1.0;
+
+  // The low bits of t hold n, build 2^n from them
+  return p * bitsToDouble((doubleToBits(t) + 1023) << 52);
+}
+
+/// cos(x) up to the sign: x = n pi + r, |r| <= pi / 2, |cos(x)| = |cos(r)|
+static inline double kernelCos(double x)
+{
+  static const double PI_HI = 3.14159265358979311600e+00;
+  static const double PI_LO = 1.22464679914735317720e-16;
+
+  double t  = x * 0.31830988618379067154 + ROUND_MAGIC;
+  double n  = t - ROUND_MAGIC;
+  double r  = (x - n * PI_HI) - n * PI_LO;
+  double r2 = r * r;
+
+  // Taylor expansion, the first neglected term is below 4e-15
+  double p = 1.0 / 6402373705728000;
+  p        = p * r2 - 1.0 / 20922789888000;
+  p        = p * r2 + 1.0 / 87178291200;
+  p        = p * r2 - 1.0 / 479001600;
+  p        = p * r2 + 1.0 / 3628800;
+  p        = p * r2 - 1.0 / 40320;
+  p        = p * r2 + 1.0 / 720;
+  p        = p * r2 - 1.0 / 24;
+  p        = p * r2 + 0.5;
+  p        = 1.0 - p * r2;
+  return p;
+}
+
+/// log(x) for 0 < x: x = 2^e m, sqrt(1/2) <= m < sqrt(2), log(m) = 2 atanh(s)
+static inline double kernelLog(double x)
+{
+  static const double LN2_HI = 6.93147180369123816490e-01;
+  static const double LN2_LO = 1.90821492927058770002e-10;
+
+  uint64_t u = doubleToBits(x);
+  uint64_t e = u >> 52;
+  double m   = bitsToDouble((u & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+  uint64_t h = (m > 1.41421356237309504880) ? 1 : 0;
+  m          = h ? m * 0.5 : m;
+
+  // e + h - 1023 as a double, through the mantissa of ROUND_MAGIC
+  double n = bitsToDouble(doubleToBits(ROUND_MAGIC) + e + h) - (ROUND_MAGIC + 1023);
+
+  // atanh series, |s| < 0.172, the first neglected term is below 1e-17
+  double s  = (m - 1) / (m + 1);
+  double s2 = s * s;
+  double p  = 1.0 / 23;
+  p         = p * s2 + 1.0 / 21;
+  p         = p * s2 + 1.0 / 19;
+  p         = p * s2 + 1.0 / 17;
+  p         = p * s2 + 1.0 / 15;
+  p         = p * s2 + 1.0 / 13;
+  p         = p * s2 + 1.0 / 11;
+  p         = p * s2 + 1.0 / 9;
+  p         = p * s2 + 1.0 / 7;
+  p         = p * s2 + 1.0 / 5;
+  p         = p * s2 + 1.0 / 3;
+  p         = p * s2 + 1.0;
+  return (n * LN2_HI + 2 * s * p) + n * LN2_LO;
+}
+
+#endif // KERNELS_EXACT
+
+static void gaussProfile(double x0, double k, int bin, int b0, int n, double *profile)
+{
+  for (int i = 0; i < n; i++)
+    profile[i] = 0.0;
+
+  // Sub-pixel loop outside, so that the inner loop runs over contiguous pixels
+  for (int s = 0; s < bin; s++) {
+    double x = double(b0) * bin + s - x0;
+    for (int i = 0; i < n; i++) {
+      double d = x + double(i) * bin;
+      profile[i] += kernelExp(-d * d * k);
+    }
+  }
+}
+
+static void axpy(double a, const double *x, double *row, int n)
+{
+  for (int i = 0; i < n; i++)
+    row[i] += a * x[i];
+}
+
+static void gaussIntegral(double x0, double sigma, int bin, int b0, int n, double *profile)
+{
+  static const double SQRT_PI_2 = 1.25331413731550025121; // sqrt(pi / 2)
+
+  // The pixel x covers [x - 0.5, x + 0.5], the integral is the difference of
+  // erf at the bin boundaries. Use erfc on the tails to keep the precision.
+  double k    = 1 / (sigma * 1.41421356237309504880);
+  double norm = sigma * SQRT_PI_2;
+  double u0   = (double(b0) * bin - 0.5 - x0) * k;
+  for (int i = 0; i < n; i++) {
+    double u1 = (double(b0 + i + 1) * bin - 0.5 - x0) * k;
+    double v;
+    if (u0 > 0)
+      v = std::erfc(u0) - std::erfc(u1);
+    else if (u1 < 0)
+      v = std::erfc(-u1) - std::erfc(-u0);
+    else
+      v = std::erf(u1) - std::erf(u0);
+    profile[i] = norm * v;
+    u0         = u1;
+  }
+}
+
+static void diffractRow(double x, double dx, double y, int n, double *row)
+{
+  static const double TWO_PI = 6.28318530717958647692;
+
+  for (int i = 0; i < n; i++) {
+    double xi  = x + double(i) * dx;
+    double r   = std::sqrt(xi * xi + y * y);
+    double w   = TWO_PI / 100 * (0.5 + r / 500);
+    double ar  = (r >= 300) ? (r - 300) : 0.0;
+    double t   = ar / 500;
+    double t2  = t * t;
+    double a   = kernelExp(-(t2 * t2)) / (r / 5000 + 0.1);
+    double c   = kernelCos(r * w);
+    double c2  = c * c;
+    double c4  = c2 * c2;
+    double c8  = c4 * c4;
+    double c16 = c8 * c8;
+    row[i] += a * (c16 * c4);
+  }
+}
+
+/// One round of the Philox4x32 counter-based generator (Salmon et al., SC'11)
+static inline void philoxRound(uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3, uint32_t k0, uint32_t k1)
+{
+  uint64_t p0 = uint64_t(0xD2511F53) * c0;
+  uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+  uint32_t t1 = c1, t3 = c3;
+  c0          = uint32_t(p1 >> 32) ^ t1 ^ k0;
+  c1          = uint32_t(p1);
+  c2          = uint32_t(p0 >> 32) ^ t3 ^ k1;
+  c3          = uint32_t(p0);
+}
+
+/// Philox4x32-10, the rounds written out so that the pixel loop vectorizes
+static inline void philox4x32(uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3, uint32_t k0, uint32_t k1)
+{
+  static const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+  philoxRound(c0, c1, c2, c3, k0, k1);
+  philoxRound(c0, c1, c2, c3, k0 + 1 * W0, k1 + 1 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 2 * W0, k1 + 2 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 3 * W0, k1 + 3 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 4 * W0, k1 + 4 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 5 * W0, k1 + 5 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 6 * W0, k1 + 6 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 7 * W0, k1 + 7 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 8 * W0, k1 + 8 * W1);
+  philoxRound(c0, c1, c2, c3, k0 + 9 * W0, k1 + 9 * W1);
+}
+
+/// (w + 0.5) / 2^32, in (0, 1)
+static inline double uniform(uint32_t w)
+{
+  // Through a signed conversion, which vectorizes on any instruction set
+  return (double(int32_t(w ^ 0x80000000)) + 2147483648.5) * (1.0 / 4294967296.0);
+}
+
+/// Counter (counter0 + i, frame_nr), key (seed, stream): one uniform and two
+/// normal deviates per counter
+static inline void randomBlock(uint32_t seed, uint32_t stream, unsigned long frame_nr, unsigned long long counter0,
+                               double *u, double *z1, double *z2, int n)
+{
+  static const double HALF_PI = 1.57079632679489661923;
+
+  uint32_t f_lo = uint32_t(frame_nr);
+  uint32_t f_hi = uint32_t((unsigned long long)frame_nr >> 32);
+  for (int i = 0; i < n; i++) {
+    uint64_t counter = counter0 + i;
+    uint32_t c0 = uint32_t(counter), c1 = uint32_t(counter >> 32), c2 = f_lo, c3 = f_hi;
+    philox4x32(c0, c1, c2, c3, seed, stream);
+
+    // Box-Muller, (r cos(phi), r sin(phi)): phi is drawn on a half circle,
+    // where kernelCos() needs no sign, and reflected by a random bit
+    double r     = std::sqrt(-2 * kernelLog(uniform(c0)));
+    double theta = uniform(c1) * (2 * HALF_PI) - HALF_PI;
+    double rc    = r * kernelCos(theta);
+    z1[i]        = (c2 & 1) ? -rc : rc;
+    z2[i]        = std::copysign(r * kernelCos(HALF_PI - std::fabs(theta)), theta);
+    u[i]         = uniform(c3);
+  }
+}
+
+static void randomRow(unsigned int seed, unsigned int stream, unsigned long frame_nr, unsigned long long counter0,
+                      double *u, double *z1, double *z2, int n)
+{
+  static const int BLOCK = 256;
+
+  for (int i0 = 0; i0 < n; i0 += BLOCK) {
+    int nb = (n - i0 < BLOCK) ? (n - i0) : BLOCK;
+    randomBlock(seed, stream, frame_nr, counter0 + i0, u + i0, z1 + i0, z2 + i0, nb);
+  }
+}
+
+/// Below this mean the Poisson deviates are sampled exactly, above it
+/// they follow the normal approximation
+static const double POISSON_GAUSS_MIN = 32;
+
+/// k[i] = Poisson deviate of mean lambda[i] >= 0, from the deviates u[i] and
+/// z[i] of randomBlock(), n <= BLOCK. k may be lambda
+static inline void poissonBlock(const double *lambda, const double *u, const double *z, double *k, int n)
+{
+  static const int BLOCK = 256;
+
+  double small[BLOCK], p[BLOCK], f[BLOCK];
+
+  // The normal approximation is rounded, as the Poisson deviates are integers
+  double small_max = 0.0;
+  for (int i = 0; i < n; i++) {
+    double l   = lambda[i];
+    double v   = std::floor(l + 0.5 + std::sqrt(l) * z[i]);
+    v          = (v > 0) ? v : 0.0;
+    bool exact = l < POISSON_GAUSS_MIN;
+    small[i]   = exact ? l : 0.0;
+    small_max  = (small[i] > small_max) ? small[i] : small_max;
+    k[i]       = exact ? 0.0 : v;
+  }
+
+  if (small_max == 0)
+    return;
+
+  // Inversion of the Poisson distribution, k = #{j >= 0 : u > F(j)}, all the
+  // deviates in lockstep up to a bound where 1 - F is far below the resolution of u
+  for (int i = 0; i < n; i++) {
+    p[i] = kernelExp(-small[i]);
+    f[i] = p[i];
+  }
+  int j_max = int(small_max + 7 * std::sqrt(small_max) + 8);
+  for (int j = 1; j <= j_max; j++) {
+    double inv_j = 1.0 / j;
+    for (int i = 0; i < n; i++) {
+      k[i] += (u[i] > f[i]) ? 1.0 : 0.0;
+      p[i] *= small[i] * inv_j;
+      f[i] += p[i];
+    }
+  }
+  for (int i = 0; i < n; i++)
+    k[i] += (u[i] > f[i]) ? 1.0 : 0.0;
+}
+
+static void poissonRow(const double *lambda, const double *u, const double *z, double *k, int n)
+{
+  static const int BLOCK = 256;
+
+  double l[BLOCK];
+  for (int i0 = 0; i0 < n; i0 += BLOCK) {
+    int nb = (n - i0 < BLOCK) ? (n - i0) : BLOCK;
+    for (int i = 0; i < nb; i++)
+      l[i] = (lambda[i0 + i] > 0) ? lambda[i0 + i] : 0.0;
+    poissonBlock(l, u + i0, z + i0, k + i0, nb);
+  }
+}
+
+static void noiseRow(const FrameKernels::NoiseModel &noise, unsigned long frame_nr, unsigned long long pixel0,
+                     const double *src, double scale, double *dst, int n)
+{
+  static const int BLOCK = 256;
+
+  double z1[BLOCK], z2[BLOCK], u[BLOCK], lambda[BLOCK];
+
+  // Local copies, dst may alias noise
+  uint32_t seed      = noise.seed;
+  bool shot_noise    = noise.shot_noise;
+  double read_noise  = noise.read_noise;
+  double dark_offset = noise.dark_offset;
+
+  for (int i0 = 0; i0 < n; i0 += BLOCK) {
+    int nb = (n - i0 < BLOCK) ? (n - i0) : BLOCK;
+
+    // Counter (pixel, frame_nr): the deviates of a pixel do not depend on
+    // the row splitting
+    randomBlock(seed, FrameKernels::NOISE_STREAM, frame_nr, pixel0 + i0, u, z1, z2, nb);
+
+    for (int i = 0; i < nb; i++) {
+      double l  = src[i0 + i] * scale;
+      lambda[i] = (l > 0) ? l : 0.0;
+    }
+    if (shot_noise)
+      poissonBlock(lambda, u, z1, lambda, nb);
+    for (int i = 0; i < nb; i++)
+      dst[i0 + i] = lambda[i] + dark_offset + read_noise * z2[i];
+  }
+}
+
+static void storeU8(const double *src, double scale, unsigned char *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 255.0) ? 255.0 : v;
+    v        = (v < 0.0) ? 0.0 : v;
+    dst[i]   = (unsigned char)(int)v;
+  }
+}
+
+static void storeU16(const double *src, double scale, unsigned short *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 65535.0) ? 65535.0 : v;
+    v        = (v < 0.0) ? 0.0 : v;
+    dst[i]   = (unsigned short)(int)v;
+  }
+}
+
+static void storeU32(const double *src, double scale, unsigned int *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 4294967295.0) ? 4294967295.0 : v;
+    v        = (v < 0.0) ? 0.0 : v;
+#if defined(KERNELS_EXACT)
+    dst[i] = (unsigned int)v;
+#else
+    // There is no packed double to unsigned conversion before AVX-512,
+    // so truncate and read the integer from the mantissa bits
+    dst[i] = (unsigned int)doubleToBits(std::trunc(v) + 4503599627370496.0); // 2^52
+#endif
+  }
+}
+
+// The bounds of the 64-bit integers are the largest doubles below 2^64 and
+// 2^63. Their packed conversions need AVX-512DQ, the other instruction sets
+// convert one pixel at a time, which is still faster than emulating them
+static const double U64_MAX = 18446744073709549568.0;
+static const double S64_MAX = 9223372036854774784.0;
+
+static void storeU64(const double *src, double scale, unsigned long long *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > U64_MAX) ? U64_MAX : v;
+    v        = (v < 0.0) ? 0.0 : v;
+    dst[i]   = (unsigned long long)v;
+  }
+}
+
+static void storeS8(const double *src, double scale, signed char *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 127.0) ? 127.0 : v;
+    v        = (v < -128.0) ? -128.0 : v;
+    dst[i]   = (signed char)(int)v;
+  }
+}
+
+static void storeS16(const double *src, double scale, short *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 32767.0) ? 32767.0 : v;
+    v        = (v < -32768.0) ? -32768.0 : v;
+    dst[i]   = (short)(int)v;
+  }
+}
+
+static void storeS32(const double *src, double scale, int *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > 2147483647.0) ? 2147483647.0 : v;
+    v        = (v < -2147483648.0) ? -2147483648.0 : v;
+    dst[i]   = (int)v;
+  }
+}
+
+static void storeS64(const double *src, double scale, long long *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > S64_MAX) ? S64_MAX : v;
+    v        = (v < -9223372036854775808.0) ? -9223372036854775808.0 : v;
+    dst[i]   = (long long)v;
+  }
+}
+
+static void storeF32(const double *src, double scale, float *dst, int n)
+{
+  static const double F32_MAX = 3.40282346638528859812e+38; // FLT_MAX
+
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > F32_MAX) ? F32_MAX : v;
+    v        = (v < -F32_MAX) ? -F32_MAX : v;
+    dst[i]   = (float)v;
+  }
+}
+
+static void storeN16(const double *src, double scale, double lo, double hi, unsigned short *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > hi) ? hi : v;
+    v        = (v < lo) ? lo : v;
+    dst[i]   = (unsigned short)(int)v;
+  }
+}
+
+static void storeN32(const double *src, double scale, double lo, double hi, unsigned int *dst, int n)
+{
+  for (int i = 0; i < n; i++) {
+    double v = src[i] * scale;
+    v        = (v > hi) ? hi : v;
+    v        = (v < lo) ? lo : v;
+    dst[i]   = (unsigned int)(int)v;
+  }
+}
+
+// The packing kernels write the pixels LSB first, each group of pixels
+// filling a whole number of bytes, and the last partial group padded with 0
+template <class T, int group, int bytes, void (*packGroup)(const T *, unsigned char *)>
+static inline void packTail(const T *src, unsigned char *dst, int n)
+{
+  int tail = n % group;
+  if (tail == 0)
+    return;
+
+  T pixels[group]            = {};
+  unsigned char packed[bytes];
+  for (int i = 0; i < tail; i++)
+    pixels[i] = src[n - tail + i];
+  packGroup(pixels, packed);
+  std::memcpy(dst + size_t(n / group) * bytes, packed, (tail * bytes * 8 / group + 7) / 8);
+}
+
+static inline void packGroup10(const unsigned short *src, unsigned char *dst)
+{
+  unsigned int a = (src[0] > 1023) ? 1023 : src[0];
+  unsigned int b = (src[1] > 1023) ? 1023 : src[1];
+  unsigned int c = (src[2] > 1023) ? 1023 : src[2];
+  unsigned int d = (src[3] > 1023) ? 1023 : src[3];
+  dst[0]         = (unsigned char)a;
+  dst[1]         = (unsigned char)((a >> 8) | (b << 2));
+  dst[2]         = (unsigned char)((b >> 6) | (c << 4));
+  dst[3]         = (unsigned char)((c >> 4) | (d << 6));
+  dst[4]         = (unsigned char)(d >> 2);
+}
+
+// Composes the groups of pixels in 64-bit words, in blocks so that the
+// composition vectorizes, then stores the 8 bytes of each word, the bytes
+// beyond the group being overwritten by the next one
+template <class T, int bits, int group>
+static inline void packWords(const T *__restrict src, unsigned char *__restrict dst, int nb_groups)
+{
+  const int block = 256;
+  const unsigned int max_value = (1U << bits) - 1;
+  unsigned long long words[block];
+  for (int g0 = 0; g0 < nb_groups; g0 += block) {
+    int nb = std::min(block, nb_groups - g0);
+    const T *s = src + size_t(g0) * group;
+    for (int g = 0; g < nb; g++) {
+      unsigned long long word = 0;
+      for (int i = 0; i < group; i++) {
+        unsigned int v = s[group * g + i];
+        v              = (v > max_value) ? max_value : v;
+        word |= (unsigned long long)v << (bits * i);
+      }
+      words[g] = word;
+    }
+    unsigned char *d = dst + size_t(g0) * (bits * group / 8);
+    for (int g = 0; g < nb; g++)
+      std::memcpy(d + g * (bits * group / 8), &words[g], sizeof(words[g]));
+  }
+}
+
+static void pack10(const unsigned short *__restrict src, unsigned char *__restrict dst, int n)
+{
+  // The last whole group must not store beyond its 5 bytes
+  int nb_groups = n / 4;
+  if (nb_groups > 0) {
+    packWords<unsigned short, 10, 4>(src, dst, nb_groups - 1);
+    packGroup10(src + 4 * (nb_groups - 1), dst + 5 * (nb_groups - 1));
+  }
+  packTail<unsigned short, 4, 5, packGroup10>(src, dst, n);
+}
+
+static inline void packGroup12(const unsigned short *src, unsigned char *dst)
+{
+  unsigned int a = (src[0] > 4095) ? 4095 : src[0];
+  unsigned int b = (src[1] > 4095) ? 4095 : src[1];
+  dst[0]         = (unsigned char)a;
+  dst[1]         = (unsigned char)((a >> 8) | (b << 4));
+  dst[2]         = (unsigned char)(b >> 4);
+}
+
+static void pack12(const unsigned short *__restrict src, unsigned char *__restrict dst, int n)
+{
+  for (int g = 0; g < n / 2; g++)
+    packGroup12(src + 2 * g, dst + 3 * g);
+  packTail<unsigned short, 2, 3, packGroup12>(src, dst, n);
+}
+
+static inline void packGroup14(const unsigned short *src, unsigned char *dst)
+{
+  unsigned int a = (src[0] > 16383) ? 16383 : src[0];
+  unsigned int b = (src[1] > 16383) ? 16383 : src[1];
+  unsigned int c = (src[2] > 16383) ? 16383 : src[2];
+  unsigned int d = (src[3] > 16383) ? 16383 : src[3];
+  dst[0]         = (unsigned char)a;
+  dst[1]         = (unsigned char)((a >> 8) | (b << 6));
+  dst[2]         = (unsigned char)(b >> 2);
+  dst[3]         = (unsigned char)((b >> 10) | (c << 4));
+  dst[4]         = (unsigned char)(c >> 4);
+  dst[5]         = (unsigned char)((c >> 12) | (d << 2));
+  dst[6]         = (unsigned char)(d >> 6);
+}
+
+static void pack14(const unsigned short *__restrict src, unsigned char *__restrict dst, int n)
+{
+  int nb_groups = n / 4;
+  if (nb_groups > 0) {
+    packWords<unsigned short, 14, 4>(src, dst, nb_groups - 1);
+    packGroup14(src + 4 * (nb_groups - 1), dst + 7 * (nb_groups - 1));
+  }
+  packTail<unsigned short, 4, 7, packGroup14>(src, dst, n);
+}
+
+static inline void packGroup24(const unsigned int *src, unsigned char *dst)
+{
+  unsigned int a = (src[0] > 16777215) ? 16777215 : src[0];
+  dst[0]         = (unsigned char)a;
+  dst[1]         = (unsigned char)(a >> 8);
+  dst[2]         = (unsigned char)(a >> 16);
+}
+
+static void pack24(const unsigned int *__restrict src, unsigned char *__restrict dst, int n)
+{
+  for (int i = 0; i < n; i++)
+    packGroup24(src + i, dst + 3 * i);
+}
+
+static const FrameKernels kernels = {
+  KERNELS_INSTRUCTION_SET,
+  gaussProfile,
+  axpy,
+  gaussIntegral,
+  diffractRow,
+  noiseRow,
+  randomRow,
+  poissonRow,
+  storeU8,
+  storeU16,
+  storeU32,
+  storeU64,
+  storeS8,
+  storeS16,
+  storeS32,
+  storeS64,
+  storeF32,
+  storeN16,
+  storeN32,
+  pack10,
+  pack12,
+  pack14,
+  pack24,
+};
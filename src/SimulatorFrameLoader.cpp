@@ -26,8 +26,10 @@
 #include <processlib/win/unistd.h>
 #endif
 
-#include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cctype>
 
@@ -36,7 +38,6 @@
 #include <fstream>
 #include <iterator>
 #include <utility>
-#include <map>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -46,6 +47,8 @@
 #include <glob.h>
 #endif // (_WIN32)
 
+#include <sys/stat.h>
+
 //#include <processlib/Data.h>
 
 #include "lima/Exceptions.h"
@@ -58,54 +61,6 @@ using namespace lima::Simulator;
 
 DEB_GLOBAL(DebModCamera);
 
-// Note: Use Boost string algo rather than this
-/// Trim both sides of a string using std::isspace
-static std::string &trim(std::string &&s)
-{
-  s.erase(s.begin(), std::find_if_not(s.begin(), s.end(), [](char c) { return std::isspace(c); }));
-  s.erase(std::find_if_not(s.rbegin(), s.rend(), [](char c) { return std::isspace(c); }).base(), s.end());
-  return s;
-}
-
-// Parse EDf header and add the result to headers map
-// Parse EDF header and add the result to headers map
-static void parseEDFHeader(std::istream& input_file, std::map<std::string, std::string>& headers)
-{
-  DEB_GLOBAL_FUNCT();
-
-  // Assume the header to be a multiple of 512 bytes
-  std::string buffer(512, '\0');
-
-  input_file.read(&buffer[0], buffer.size());
-  if (buffer[0] != '{')
-    throw LIMA_EXC(CameraPlugin, Error, "Invalid EDF file");
-
-  std::stringstream ss;
-  ss << buffer;
-
-  // More buffer in header?
-  while ((buffer.rfind('}') == std::string::npos) && !input_file.eof()) {
-    input_file.read(&buffer[0], buffer.size());
-    ss << buffer;
-  }
-
-  // Parse header
-  while (!ss.eof()) {
-    std::string line;
-    std::getline(ss, line);
-
-    // Get rid of any comment
-    std::string::size_type comment = line.rfind(';');
-    if (comment != std::string::npos)
-      line.resize(comment);
-
-    // Tokenize
-    std::string::size_type token_pos = line.find('=');
-    if (token_pos != std::string::npos)
-      headers.insert(std::make_pair(trim(line.substr(0, token_pos)), trim(line.substr(token_pos + 1))));
-  }
-}
-
 static ImageType getImageType(const std::string &type)
 {
   DEB_GLOBAL_FUNCT();
@@ -138,6 +93,84 @@ static ImageType getImageType(const std::string &type)
   return res;
 }
 
+/// The EDF header keywords interpreted by the loader
+struct EDFHeader {
+  size_t header_size; //<! Size of the header, a multiple of 512 bytes
+  FrameDim frame_dim;
+  size_t data_size;   //<! The Size keyword, 0 if missing
+};
+
+/// Trim both sides of the [begin, end) range using std::isspace
+static void trim(const char *&begin, const char *&end)
+{
+  while ((begin != end) && std::isspace((unsigned char) *begin))
+    begin++;
+  while ((end != begin) && std::isspace((unsigned char) end[-1]))
+    end--;
+}
+
+// Parse the EDF header at the beginning of the [begin, end) buffer, in place
+static void parseEDFHeader(const char *begin, const char *end, EDFHeader &header)
+{
+  DEB_GLOBAL_FUNCT();
+
+  if ((begin == end) || (*begin != '{'))
+    throw LIMA_EXC(CameraPlugin, Error, "Invalid EDF file");
+
+  // The header ends with the 512-byte block holding the closing brace
+  const char *header_end = std::find(begin, end, '}');
+  if (header_end == end)
+    throw LIMA_EXC(CameraPlugin, Error, "Truncated EDF header");
+  header.header_size = (size_t(header_end - begin) / 512 + 1) * 512;
+
+  int dim_1 = -1, dim_2 = -1;
+  std::string data_type;
+  header.data_size = 0;
+
+  // Parse header
+  for (const char *line = begin + 1; line < header_end;) {
+    const char *line_end = std::find(line, header_end, '\n');
+    const char *next     = line_end + 1;
+
+    // Get rid of any comment
+    const char *comment = std::find(std::reverse_iterator<const char *>(line_end),
+                                    std::reverse_iterator<const char *>(line), ';')
+                              .base();
+    if (comment != line)
+      line_end = comment - 1;
+
+    // Tokenize
+    const char *token_pos = std::find(line, line_end, '=');
+    if (token_pos != line_end) {
+      const char *key = line, *key_end = token_pos;
+      const char *val = token_pos + 1, *val_end = line_end;
+      trim(key, key_end);
+      trim(val, val_end);
+
+      const std::string::size_type key_len = key_end - key;
+      if ((key_len == 5) && !std::strncmp(key, "Dim_1", 5))
+        dim_1 = std::atoi(val);
+      else if ((key_len == 5) && !std::strncmp(key, "Dim_2", 5))
+        dim_2 = std::atoi(val);
+      else if ((key_len == 8) && !std::strncmp(key, "DataType", 8))
+        data_type.assign(val, val_end);
+      else if ((key_len == 4) && !std::strncmp(key, "Size", 4))
+        header.data_size = std::strtoull(val, NULL, 10);
+    }
+
+    line = next;
+  }
+
+  if ((dim_1 < 0) || (dim_2 < 0))
+    throw LIMA_EXC(CameraPlugin, Error, "Missing Dim_1 or Dim_2 header in EDF file");
+
+  // Interpret header
+  if (data_type.empty())
+    throw LIMA_EXC(CameraPlugin, Error, "Missing DataType header in EDF file");
+
+  header.frame_dim = FrameDim(Size(dim_1, dim_2), getImageType(data_type));
+}
+
 static void findFiles(const std::string &path_pattern, std::vector<std::string> &files)
 {
   DEB_GLOBAL_FUNCT();
@@ -178,6 +211,399 @@ static void findFiles(const std::string &path_pattern, std::vector<std::string>
 #endif // _WIN32
 }
 
+// Returns the extension of a file name, with the dot
+static std::string getExtension(const std::string &file)
+{
+#if defined(_WIN32)
+  // std::string path(MAX_PATH, '\0');
+  // PathCombine(&path[0], m_folder.c_str(), file.c_str());
+  return std::string(PathFindExtension(file.c_str()));
+#else
+  // std::string path = folder + "/" + file;
+  const size_t pos = file.rfind('.');
+  return (pos == 0) || (pos == std::string::npos) ? std::string() : file.substr(pos);
+#endif // _WIN32
+}
+
+// Get the size and the modification time (in ns on Linux, s otherwise) of a
+// file, false if it does not exist
+static bool getFileStat(const std::string &file, unsigned long long &size, long long &mtime)
+{
+#if defined(_WIN32)
+  struct _stat64 st;
+  if (_stat64(file.c_str(), &st) != 0)
+    return false;
+#else
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0)
+    return false;
+#endif // _WIN32
+  size  = (unsigned long long) st.st_size;
+#if defined(__linux__)
+  mtime = (long long) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+  mtime = (long long) st.st_mtime;
+#endif
+  return true;
+}
+
+/// A frame found in a file
+struct FileFrame {
+  FrameDim frame_dim;
+  unsigned long long offset; //<! Offset of the frame data in the file
+};
+
+// Walk the headers of an EDF file, the data sections being skipped
+static void scanEDFFile(const std::string &file, std::vector<FileFrame> &frames)
+{
+  DEB_GLOBAL_FUNCT();
+
+  // Only the pages of the headers are read
+  MappedFile mapped_file(file);
+  const char *data = reinterpret_cast<const char *>(mapped_file.data());
+  const size_t size = mapped_file.size();
+
+  for (size_t offset = 0, frame_nr = 0; offset < size; frame_nr++) {
+    EDFHeader header;
+    parseEDFHeader(data + offset, data + size, header);
+
+    FileFrame frame;
+    frame.frame_dim       = header.frame_dim;
+    const size_t mem_size = getFrameMemSize(frame.frame_dim);
+    if (header.data_size && (mem_size != header.data_size))
+      throw LIMA_EXC(CameraPlugin, Error,
+                     "Size of frame " + std::to_string(frame_nr) + " of EDF file " + file +
+                         " does not match its dimensions");
+
+    if ((header.header_size > size - offset) || (mem_size > size - offset - header.header_size))
+      throw LIMA_EXC(CameraPlugin, Error, "Truncated data section in EDF file " + file);
+
+    frame.offset = offset + header.header_size;
+    frames.push_back(frame);
+
+    offset += header.header_size + mem_size;
+  }
+}
+
+/// The file formats read by the loader
+enum FileFormat {
+  EDFFormat,
+  Hdf5Format, //<! HDF5 or NeXus
+  NpyFormat,  //<! NumPy array
+  RawFormat,  //<! Headerless frames
+};
+
+// Returns the format of a file, from its extension
+static FileFormat getFileFormat(const std::string &file)
+{
+  const std::string extension = getExtension(file);
+  if (extension == ".edf")
+    return EDFFormat;
+  else if ((extension == ".h5") || (extension == ".hdf5") || (extension == ".hdf") || (extension == ".nxs"))
+    return Hdf5Format;
+  else if (extension == ".npy")
+    return NpyFormat;
+  else if ((extension == ".raw") || (extension == ".bin"))
+    return RawFormat;
+  else
+    throw LIMA_EXC(CameraPlugin, NotSupported, "Unsupported file format");
+}
+
+// Index the frames of an HDF5 dataset. The frames stored as is are read like
+// the EDF frames, straight from the file. Otherwise the dataset is returned
+// open, to read the frames through the library, and the offset of a frame is
+// its number in the dataset.
+static void scanHdf5File(const std::string &file, const std::string &dataset, std::vector<FileFrame> &frames,
+                         std::unique_ptr<Hdf5File> &hdf5_file)
+{
+  DEB_GLOBAL_FUNCT();
+
+  std::unique_ptr<Hdf5File> dataset_file(new Hdf5File(file, dataset));
+
+  FileFrame frame;
+  unsigned long nb_frames;
+  dataset_file->getFrameDim(frame.frame_dim);
+  dataset_file->getNbFrames(nb_frames);
+  frames.resize(nb_frames, frame);
+
+  bool is_raw = true;
+  for (unsigned long frame_nr = 0; is_raw && (frame_nr < nb_frames); frame_nr++)
+    is_raw = dataset_file->getFrameOffset(frame_nr, frames[frame_nr].offset);
+
+  if (!is_raw) {
+    DEB_TRACE() << "Read " << file << " through HDF5";
+    for (unsigned long frame_nr = 0; frame_nr < nb_frames; frame_nr++)
+      frames[frame_nr].offset = frame_nr;
+    hdf5_file = std::move(dataset_file);
+  }
+}
+
+/// The NumPy header fields interpreted by the loader
+struct NpyHeader {
+  size_t header_size;      //<! Offset of the array data
+  FrameDim frame_dim;
+  unsigned long nb_frames; //<! 1 for a 2-D array
+};
+
+// Get the image type of a NumPy array type, i.e. '<u2'
+static ImageType getNpyImageType(const std::string &descr)
+{
+  // Only the little-endian types are read as is
+  if ((descr.size() != 3) || ((descr[0] != '<') && (descr[0] != '|')))
+    throw LIMA_EXC(CameraPlugin, Error, "Unsupported pixel type in NumPy file");
+
+  const std::string type = descr.substr(1);
+  if (type == "u1")
+    return ImageType::Bpp8;
+  else if (type == "i1")
+    return ImageType::Bpp8S;
+  else if (type == "u2")
+    return ImageType::Bpp16;
+  else if (type == "i2")
+    return ImageType::Bpp16S;
+  else if (type == "u4")
+    return ImageType::Bpp32;
+  else if (type == "i4")
+    return ImageType::Bpp32S;
+  else if (type == "f4")
+    return ImageType::Bpp32F;
+  else
+    throw LIMA_EXC(CameraPlugin, Error, "Unsupported pixel type in NumPy file");
+}
+
+// Find the value of a key of the NumPy header dictionary, false if missing
+static bool findNpyValue(const std::string &dict, const std::string &key, const char *&value)
+{
+  std::string::size_type pos = dict.find("'" + key + "'");
+  if (pos == std::string::npos)
+    return false;
+  pos = dict.find(':', pos + key.size() + 2);
+  if (pos == std::string::npos)
+    return false;
+
+  value = dict.c_str() + pos + 1;
+  while (std::isspace((unsigned char) *value))
+    value++;
+  return true;
+}
+
+// Parse the NumPy header at the beginning of the [begin, end) buffer, the
+// repr() of a dictionary with the descr, fortran_order and shape keys
+static void parseNpyHeader(const char *begin, const char *end, NpyHeader &header)
+{
+  DEB_GLOBAL_FUNCT();
+
+  static const char magic[] = "\x93NUMPY";
+  if ((end - begin < 10) || std::memcmp(begin, magic, 6))
+    throw LIMA_EXC(CameraPlugin, Error, "Invalid NumPy file");
+
+  // The length of the dictionary is stored on 2 bytes (version 1) or 4
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(begin);
+  size_t dict_offset, dict_size;
+  if (bytes[6] == 1) {
+    dict_offset = 10;
+    dict_size   = size_t(bytes[8]) | (size_t(bytes[9]) << 8);
+  } else if (((bytes[6] == 2) || (bytes[6] == 3)) && (end - begin >= 12)) {
+    dict_offset = 12;
+    dict_size   = size_t(bytes[8]) | (size_t(bytes[9]) << 8) | (size_t(bytes[10]) << 16) | (size_t(bytes[11]) << 24);
+  } else
+    throw LIMA_EXC(CameraPlugin, Error, "Unsupported NumPy file version");
+
+  if (dict_size > size_t(end - begin) - dict_offset)
+    throw LIMA_EXC(CameraPlugin, Error, "Truncated NumPy header");
+  header.header_size = dict_offset + dict_size;
+
+  const std::string dict(begin + dict_offset, dict_size);
+  const char *value;
+
+  if (!findNpyValue(dict, "descr", value) || ((*value != '\'') && (*value != '"')))
+    throw LIMA_EXC(CameraPlugin, Error, "Missing descr in NumPy header");
+  const char *descr_end = std::strchr(value + 1, *value);
+  if (!descr_end)
+    throw LIMA_EXC(CameraPlugin, Error, "Missing descr in NumPy header");
+  const ImageType image_type = getNpyImageType(std::string(value + 1, descr_end));
+
+  if (findNpyValue(dict, "fortran_order", value) && !std::strncmp(value, "True", 4))
+    throw LIMA_EXC(CameraPlugin, NotSupported, "Fortran order not supported in NumPy file");
+
+  // A single frame (height, width) or a stack of frames (nb_frames, height, width)
+  if (!findNpyValue(dict, "shape", value) || (*value != '('))
+    throw LIMA_EXC(CameraPlugin, Error, "Missing shape in NumPy header");
+  std::vector<unsigned long long> shape;
+  for (value++; *value && (*value != ')');) {
+    char *dim_end;
+    shape.push_back(std::strtoull(value, &dim_end, 10));
+    if (dim_end == value)
+      throw LIMA_EXC(CameraPlugin, Error, "Invalid shape in NumPy header");
+    value = dim_end;
+    while (std::isspace((unsigned char) *value) || (*value == ','))
+      value++;
+  }
+  if ((shape.size() != 2) && (shape.size() != 3))
+    throw LIMA_EXC(CameraPlugin, Error, "Unsupported shape of NumPy array, not 2-D or 3-D");
+
+  const size_t rank  = shape.size();
+  header.nb_frames   = (rank == 3) ? (unsigned long) shape[0] : 1;
+  header.frame_dim   = FrameDim(int(shape[rank - 1]), int(shape[rank - 2]), image_type);
+}
+
+// Index the frames of a NumPy file, stored one after the other after the header
+static void scanNpyFile(const std::string &file, std::vector<FileFrame> &frames)
+{
+  DEB_GLOBAL_FUNCT();
+
+  // Only the page of the header is read
+  MappedFile mapped_file(file);
+  const char *data = reinterpret_cast<const char *>(mapped_file.data());
+  const size_t size = mapped_file.size();
+
+  NpyHeader header;
+  parseNpyHeader(data, data + size, header);
+
+  FileFrame frame;
+  frame.frame_dim       = header.frame_dim;
+  const size_t mem_size = getFrameMemSize(frame.frame_dim);
+  if (!mem_size)
+    throw LIMA_EXC(CameraPlugin, Error, "Empty array in NumPy file " + file);
+  if (header.nb_frames > (size - header.header_size) / mem_size)
+    throw LIMA_EXC(CameraPlugin, Error, "Truncated data in NumPy file " + file);
+
+  frames.reserve(header.nb_frames);
+  for (unsigned long frame_nr = 0; frame_nr < header.nb_frames; frame_nr++) {
+    frame.offset = header.header_size + (unsigned long long) frame_nr * mem_size;
+    frames.push_back(frame);
+  }
+}
+
+// Index the frames of a raw file, stored one after the other without header
+static void scanRawFile(const std::string &file, const FrameDim &frame_dim, std::vector<FileFrame> &frames)
+{
+  DEB_GLOBAL_FUNCT();
+
+  const size_t mem_size = getFrameMemSize(frame_dim);
+  if (!mem_size)
+    throw LIMA_EXC(CameraPlugin, Error, "The frame dimensions of the raw files are not set");
+
+  unsigned long long size;
+  long long mtime;
+  if (!getFileStat(file, size, mtime))
+    throw LIMA_EXC(CameraPlugin, Error, "Failed to open raw file " + file);
+  if (size % mem_size)
+    throw LIMA_EXC(CameraPlugin, Error, "Size of raw file " + file + " is not a multiple of the frame size");
+
+  FileFrame frame;
+  frame.frame_dim = frame_dim;
+  frames.reserve(size / mem_size);
+  for (unsigned long long offset = 0; offset < size; offset += mem_size) {
+    frame.offset = offset;
+    frames.push_back(frame);
+  }
+}
+
+static const char index_magic[] = "# LImA Simulator frame index v1";
+
+// Load the index of the files if it is up to date, false otherwise
+static bool loadIndex(const std::string &index_file, const std::vector<std::string> &files, FrameDim &frame_dim,
+                      std::vector<std::pair<unsigned int, unsigned long long>> &index)
+{
+  DEB_GLOBAL_FUNCT();
+
+  std::ifstream input_file(index_file.c_str());
+  if (!input_file.is_open())
+    return false;
+
+  std::string line;
+  if (!std::getline(input_file, line) || (line != index_magic))
+    return false;
+
+  // The files must be the same, unchanged
+  size_t nb_files;
+  if (!(input_file >> nb_files) || (nb_files != files.size()))
+    return false;
+  for (const std::string &file : files) {
+    unsigned long long size, file_size;
+    long long mtime, file_mtime;
+    if (!(input_file >> size >> mtime) || (input_file.get() != ' ') || !std::getline(input_file, line))
+      return false;
+    if ((line != file) || !getFileStat(file, file_size, file_mtime) || (size != file_size) || (mtime != file_mtime))
+      return false;
+  }
+
+  int width, height, image_type;
+  size_t nb_frames;
+  if (!(input_file >> width >> height >> image_type >> nb_frames))
+    return false;
+  frame_dim = FrameDim(width, height, ImageType(image_type));
+
+  index.resize(nb_frames);
+  for (auto &frame : index)
+    if (!(input_file >> frame.first >> frame.second) || (frame.first >= nb_files))
+      return false;
+
+  return true;
+}
+
+// Save the index of the files, replacing the index file atomically
+static void saveIndex(const std::string &index_file, const std::vector<std::string> &files, const FrameDim &frame_dim,
+                      const std::vector<std::pair<unsigned int, unsigned long long>> &index)
+{
+  DEB_GLOBAL_FUNCT();
+
+  const std::string tmp_file = index_file + ".tmp";
+  {
+    std::ofstream output_file(tmp_file.c_str());
+    output_file << index_magic << '\n' << files.size() << '\n';
+    for (const std::string &file : files) {
+      unsigned long long size = 0;
+      long long mtime         = 0;
+      getFileStat(file, size, mtime);
+      output_file << size << ' ' << mtime << ' ' << file << '\n';
+    }
+
+    const Size &size = frame_dim.getSize();
+    output_file << size.getWidth() << ' ' << size.getHeight() << ' ' << int(frame_dim.getImageType()) << ' '
+                << index.size() << '\n';
+    for (const auto &frame : index)
+      output_file << frame.first << ' ' << frame.second << '\n';
+
+    if (!output_file.good()) {
+      DEB_WARNING() << "Failed to write the frame index " << tmp_file;
+      return;
+    }
+  }
+
+#if defined(_WIN32)
+  std::remove(index_file.c_str());
+#endif // _WIN32
+  if (std::rename(tmp_file.c_str(), index_file.c_str()) != 0)
+    DEB_WARNING() << "Failed to write the frame index " << index_file;
+}
+
+FrameLoader::FrameLoader() :
+  m_dataset_path("/entry_0000/measurement/data"), m_read_mode(Streamed), m_read_ahead_depth(0), m_ring_first(0),
+  m_ring_ready(0), m_reader_busy(false), m_reader_stop(false), m_nb_stalls(0), m_bytes_read(0)
+{
+}
+
+FrameLoader::~FrameLoader()
+{
+  stopReader();
+}
+
+/**
+ * @brief Sets the file pattern used to load the frames and indexes
+ *the frames of the files
+ *
+ * The files are EDF, HDF5 (.h5, .hdf5, .hdf, .nxs), NumPy (.npy) or
+ *raw (.raw, .bin) files. The frames of the HDF5 files are read from
+ *the dataset set by setDatasetPath(), the raw files hold frames of
+ *the dimensions set by setRawFrameDim(). The files are indexed in
+ *parallel and their frames are concatenated in the order of the file
+ *names. All the frames must have the same dimensions.
+ *
+ * @param[in] file_pattern  std::string that may include a globing
+ *pattern, i.e. input/test_*.edf
+ *******************************************************************/
 void FrameLoader::setFilePattern(const std::string &file_pattern)
 {
   DEB_MEMBER_FUNCT();
@@ -185,168 +611,521 @@ void FrameLoader::setFilePattern(const std::string &file_pattern)
   if (m_file_pattern != file_pattern)
     m_file_pattern = file_pattern;
 
-  // Clear the file list
+  // The reader uses the index
+  stopReader();
+
+  {
+    std::lock_guard<std::mutex> lock(m_file_readers_mutex);
+    m_file_readers.clear();
+    m_open_files.clear();
+  }
+
+  // Clear the file list and the index
   m_files.clear();
+  m_index.clear();
+  m_hdf5_files.clear();
 
   // Find the files using the new pattern
   findFiles(file_pattern, m_files);
 
-  if (!m_files.empty()) {
-    // Get the first file
-    const std::string &file = m_files.front();
+  if (m_files.empty())
+    throw LIMA_EXC(CameraPlugin, Error, "No file found with the given pattern");
 
-    // Get the file path and extension
-#if defined(_WIN32)
-    // std::string path(MAX_PATH, '\0');
-    // PathCombine(&path[0], m_folder.c_str(), file.c_str());
-    const std::string extension(PathFindExtension(file.c_str()));
-#else
-    // std::string path = folder + "/" + file;
-    const size_t pos            = file.rfind('.');
-    const std::string extension = pos == 0 ? std::string() : file.substr(pos);
-#endif // _WIN32
+  // Only the index of the EDF files is persisted, the other files are
+  // indexed from a single header
+  std::vector<FileFormat> formats;
+  bool is_edf = true;
+  for (const std::string &file : m_files) {
+    formats.push_back(getFileFormat(file));
+    is_edf = is_edf && (formats.back() == EDFFormat);
+  }
+  m_hdf5_files.resize(m_files.size());
 
-    Size size;
-    ImageType image_type;
+  if (!m_index_file.empty() && is_edf && loadIndex(m_index_file, m_files, m_frame_dim, m_index))
+    DEB_TRACE() << "Loaded " << m_index.size() << " frames from index " << m_index_file;
+  else {
+    m_index.clear();
 
-    if (extension == ".edf") {
-      // Open the file and parse the header
-      std::ifstream input_file(file.c_str(), std::ios::binary);
-      if (!input_file.is_open()) throw LIMA_EXC(CameraPlugin, Error, "Failed to open EDF file");
+    // Parse the headers of the files in parallel
+    std::vector<std::vector<FileFrame>> file_frames(m_files.size());
+    std::vector<std::string> errors(m_files.size());
+#pragma omp parallel for schedule(dynamic)
+    for (long i = 0; i < long(m_files.size()); i++) {
+      try {
+        switch (formats[i]) {
+        case EDFFormat:
+          scanEDFFile(m_files[i], file_frames[i]);
+          break;
+        case Hdf5Format:
+          scanHdf5File(m_files[i], m_dataset_path, file_frames[i], m_hdf5_files[i]);
+          break;
+        case NpyFormat:
+          scanNpyFile(m_files[i], file_frames[i]);
+          break;
+        case RawFormat:
+          scanRawFile(m_files[i], m_raw_frame_dim, file_frames[i]);
+          break;
+        }
+      } catch (Exception &e) {
+        errors[i] = e.getErrMsg();
+      }
+    }
 
-      std::map<std::string, std::string> headers;
-      parseEDFHeader(input_file, headers);
+    for (size_t file_nr = 0; file_nr < m_files.size(); file_nr++) {
+      if (!errors[file_nr].empty())
+        throw LIMA_EXC(CameraPlugin, Error, errors[file_nr]);
 
-      Point p;
-      p.x  = std::stoi(headers["Dim_1"]); // C++11
-      p.y  = std::stoi(headers["Dim_2"]);
-      size = p;
+      for (const FileFrame &frame : file_frames[file_nr]) {
+        if (m_index.empty())
+          m_frame_dim = frame.frame_dim;
+        else if (frame.frame_dim != m_frame_dim)
+          throw LIMA_EXC(CameraPlugin, Error, "Frame dimensions do not match in " + m_files[file_nr]);
+        m_index.push_back(std::make_pair((unsigned int) file_nr, frame.offset));
+      }
+    }
 
-      // Interpret header
-      auto val = headers.find("DataType");
-      if (val != headers.end())
-        image_type = getImageType(val->second);
-      else
-        throw LIMA_EXC(CameraPlugin, Error, "Missing DataType header in EDF file");
-    } else
-      throw LIMA_EXC(CameraPlugin, NotSupported, "Unsupported file format");
+    if (m_index.empty())
+      throw LIMA_EXC(CameraPlugin, Error, "No frame found in the files");
 
-    m_frame_dim = FrameDim(size, image_type);
+    if (!m_index_file.empty() && is_edf)
+      saveIndex(m_index_file, m_files, m_frame_dim, m_index);
+  }
 
-    DEB_TRACE() << DEB_VAR1(m_frame_dim);
+  DEB_TRACE() << DEB_VAR2(m_frame_dim, m_index.size());
 
-    // Signal LiMA core that the frame properties may have changed
-    maxImageSizeChanged(size, image_type);
-  } else
-    throw LIMA_EXC(CameraPlugin, Error, "No file found with the given pattern");
+  // Signal LiMA core that the frame properties may have changed
+  maxImageSizeChanged(m_frame_dim.getSize(), m_frame_dim.getImageType());
 }
 
-void FrameLoader::prepareAcq()
+/**
+ * @brief Sets the path of the dataset of frames in the HDF5 files,
+ *effective at the next setFilePattern()
+ *
+ * The dataset holds a single frame (height, width) or a stack of
+ *frames (nb_frames, height, width).
+ *
+ * @param[in] dataset_path  std::string, /entry_0000/measurement/data
+ *(default) as written by LImA
+ *******************************************************************/
+void FrameLoader::setDatasetPath(const std::string &dataset_path)
 {
   DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(dataset_path);
 
-  if (!m_files.empty()) {
-    if (m_current_stream->is_open())
-      // Close the current file
-      m_current_stream->close();
-    
-    // Position the iterator
-    m_it_current_file = m_files.begin();
-
-    // Open the file
-    m_current_stream->open(m_it_current_file->c_str(), std::ios::binary);
-    DEB_TRACE() << "Open file " << *m_it_current_file;
-    if (!m_current_stream->is_open())
-      throw LIMA_EXC(CameraPlugin, Error, "Failed to open file");
-  }
+  m_dataset_path = dataset_path;
 }
 
-bool FrameLoader::getFrame(unsigned long frame_nr, unsigned char *ptr)
+/**
+ * @brief Sets the dimensions of the frames of the raw files,
+ *effective at the next setFilePattern()
+ *
+ * A raw file holds frames stored one after the other, without header,
+ *its size must be a multiple of the frame size.
+ *
+ * @param[in] frame_dim  FrameDim
+ *******************************************************************/
+void FrameLoader::setRawFrameDim(const FrameDim &frame_dim)
 {
   DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_dim);
 
-  if (m_it_current_file != m_files.end()) {
-    Size size;
-    ImageType image_type;
+  m_raw_frame_dim = frame_dim;
+}
 
-    const std::string &file = *m_it_current_file;
+/**
+ * @brief Sets the file the frame index is persisted to, effective at
+ *the next setFilePattern()
+ *
+ * The index is loaded from the file if the files matching the pattern
+ *did not change since it was written, the files are indexed and the
+ *index is written otherwise. Only the index of EDF files is persisted.
+ *
+ * @param[in] index_file  std::string, empty (default) not to persist
+ *the index
+ *******************************************************************/
+void FrameLoader::setIndexFile(const std::string &index_file)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(index_file);
 
-    FrameDim frame_dim;
+  m_index_file = index_file;
+}
 
-    // Get the file extension
-#if defined(_WIN32)
-    // std::string path(MAX_PATH, '\0');
-    // PathCombine(&path[0], m_folder.c_str(), file.c_str());
-    const std::string extension(PathFindExtension(file.c_str()));
-#else
-    // std::string path = m_folder + "/" + file;
-    const size_t pos            = file.rfind('.');
-    const std::string extension = pos == 0 ? std::string() : file.substr(pos);
-#endif // _WIN32
+/**
+ * @brief Gets the number of frames found in the files
+ *
+ * @param[out] nb_frames  unsigned long
+ *******************************************************************/
+void FrameLoader::getNbFrames(unsigned long &nb_frames) const
+{
+  nb_frames = (unsigned long) m_index.size();
+}
 
-    if (extension == ".edf") {
-      if (m_current_stream->peek() == EOF) {
-        DEB_TRACE() << "EOF " << *m_it_current_file << " skip to next file";
-        
-        m_current_stream->close();
-
-        // Skip to next file
-        m_it_current_file++;
-
-        if (m_it_current_file != m_files.end())
-        {
-          // Open next file
-          m_current_stream->open(m_it_current_file->c_str(), std::ios::binary);
-          DEB_TRACE() << "Open file " << *m_it_current_file;
-          if (!m_current_stream->is_open())
-            throw LIMA_EXC(CameraPlugin, Error, "Failed to open file");
-        }
-        else
-          throw LIMA_EXC(CameraPlugin, Error, "End of file list");
+/**
+ * @brief Sets how the frames are read from the files, effective at
+ *the next prepareAcq()
+ *
+ * In the Mapped mode, the files are mapped in memory by prepareAcq()
+ *and the frames are copied straight from the mappings. In the Direct
+ *mode, the files are read bypassing the page cache: the blocks holding
+ *a frame are read into an aligned staging buffer and only the frame
+ *data is copied, so replaying large files does not fill the memory.
+ *
+ * @param[in] read_mode  ReadMode
+ *******************************************************************/
+void FrameLoader::setReadMode(ReadMode read_mode)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(read_mode);
+
+  stopReader();
+  m_read_mode = read_mode;
+}
+
+/**
+ * @brief Sets the number of frames read ahead of getFrame(),
+ *effective at the next prepareAcq()
+ *
+ * A background thread reads the frames following the last one
+ *requested into a ring of nb_frames buffers, so getFrame() only
+ *copies a frame already read, unless the reader is late. A request
+ *out of sequence restarts the reader from the requested frame. The
+ *prefetched frames being read in parallel, in any order, the frames
+ *of a FramePrefetcher are not read ahead.
+ *
+ * @param[in] nb_frames  unsigned int, 0 (default) reads the frames
+ *synchronously
+ *
+ * @exception lima::Exception  Frames read ahead and prefetched
+ *******************************************************************/
+void FrameLoader::setReadAheadDepth(unsigned int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if (nb_frames && (getMode() == Camera::MODE_LOADER_PREFETCH))
+    throw LIMA_EXC(CameraPlugin, NotSupported, "Read ahead not supported with prefetched frames");
+
+  stopReader();
+  m_read_ahead_depth = nb_frames;
+}
+
+/**
+ * @brief Gets the number of frames read ahead and not yet requested
+ *
+ * @param[out] nb_frames  unsigned int
+ *******************************************************************/
+void FrameLoader::getReadAheadLevel(unsigned int &nb_frames) const
+{
+  std::lock_guard<std::mutex> lock(m_ring_mutex);
+  nb_frames = (unsigned int) (m_ring_ready - m_ring_first);
+}
+
+/**
+ * @brief Gets the number of getFrame() calls that waited for the
+ *frame to be read ahead since the last prepareAcq()
+ *
+ * @param[out] nb_stalls  unsigned long
+ *******************************************************************/
+void FrameLoader::getReadAheadStalls(unsigned long &nb_stalls) const
+{
+  std::lock_guard<std::mutex> lock(m_ring_mutex);
+  nb_stalls = m_nb_stalls;
+}
+
+/**
+ * @brief Gets the average rate of the reads ahead since the last
+ *prepareAcq()
+ *
+ * @param[out] bytes_per_sec  double, 0 if nothing was read
+ *******************************************************************/
+void FrameLoader::getReadAheadRate(double &bytes_per_sec) const
+{
+  std::lock_guard<std::mutex> lock(m_ring_mutex);
+  std::chrono::duration<double> elapsed = m_read_end - m_read_start;
+  bytes_per_sec = (elapsed.count() > 0) ? m_bytes_read / elapsed.count() : 0;
+}
+
+void FrameLoader::prepareAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  stopReader();
+  {
+    // The files may have been replaced
+    std::lock_guard<std::mutex> lock(m_file_readers_mutex);
+    m_file_readers.assign(m_files.size(), std::shared_ptr<const FileReader>());
+    m_open_files.clear();
+  }
+  m_mapped_files.clear();
+  {
+    // The frame dimensions may have changed
+    std::lock_guard<std::mutex> lock(m_staging_mutex);
+    m_staging_buffers.clear();
+  }
+
+  if ((m_read_mode == Mapped) && !m_index.empty()) {
+    // Map all the files, the descriptors are not kept open. The files
+    // are read in order: the kernel reads them ahead and soon drops the
+    // pages read. WillNeed hints proved slower, the pages they read ahead
+    // being mapped one by one.
+    m_mapped_files.resize(m_files.size());
+    for (size_t file_nr = 0; file_nr < m_files.size(); file_nr++)
+      if (!m_hdf5_files[file_nr]) {
+        m_mapped_files[file_nr].open(m_files[file_nr]);
+        m_mapped_files[file_nr].advise(MappedFile::Sequential);
       }
+    DEB_TRACE() << "Mapped " << m_mapped_files.size() << " files";
+  }
 
-      // Check if the file is still open
-      if (!m_current_stream->is_open())
-        throw LIMA_EXC(CameraPlugin, Error, "Failed to open EDF file");
-
-      // Parse the header
-      std::map<std::string, std::string> headers;
-      parseEDFHeader(*m_current_stream, headers);
-
-      Point p;
-      p.x  = std::stoi(headers["Dim_1"]); // C++11
-      p.y  = std::stoi(headers["Dim_2"]);
-      size = p;
-
-      // Interpret header
-      auto val = headers.find("DataType");
-      if (val != headers.end())
-        image_type = getImageType(val->second);
-
-      frame_dim          = FrameDim(size, image_type);
-      const int mem_size = frame_dim.getMemSize();
-
-      DEB_TRACE() << DEB_VAR2(frame_dim, mem_size);
-
-      assert(frame_dim.getMemSize() == std::stol(headers["Size"]));
-      
-      if (m_frame_dim != frame_dim)
-        throw LIMA_EXC(CameraPlugin, Error, "Frame dimensions do not match");
-
-      // Read the frame data
-      m_current_stream->read(reinterpret_cast<char *>(ptr), mem_size);
-      if (m_current_stream->fail())
-        throw LIMA_EXC(CameraPlugin, Error, "Failed to read data section of EDF file");
-      
-      std::stringstream os;
-      unsigned short* data = (unsigned short*) ptr;
-      os << std::hex << data[0] << ' ' << data[1] << ' '<< data[2] << ' '<< data[3];
-      DEB_TRACE() << "data: " << os.str();
-    } else
-      throw LIMA_EXC(CameraPlugin, NotSupported, "Unsupported file format");
+  if (m_read_ahead_depth && !m_index.empty())
+    startReader();
+}
 
-  } else
+bool FrameLoader::getFrame(unsigned long frame_nr, unsigned char *ptr)
+{
+  DEB_MEMBER_FUNCT();
+
+  if (m_index.empty())
     return false;
 
+  if (frame_nr >= m_index.size())
+    throw LIMA_EXC(CameraPlugin, Error, "End of file list");
+
+  if (m_reader.joinable())
+    getReadAheadFrame(frame_nr, ptr);
+  else
+    readFrame(frame_nr, ptr);
+
   return true;
 }
+
+// Get the reader of a file, opening it if needed. At most max_open_files
+// files stay open, the oldest being closed when its last read completes.
+std::shared_ptr<const FileReader> FrameLoader::getFileReader(unsigned int file_nr) const
+{
+  DEB_MEMBER_FUNCT();
+
+  static const size_t max_open_files = 64;
+
+  std::lock_guard<std::mutex> lock(m_file_readers_mutex);
+
+  // prepareAcq() was not called
+  if (m_file_readers.size() != m_files.size())
+    m_file_readers.resize(m_files.size());
+
+  std::shared_ptr<const FileReader> &file_reader = m_file_readers[file_nr];
+  if (!file_reader) {
+    DEB_TRACE() << "Open file " << m_files[file_nr];
+    file_reader = std::make_shared<const FileReader>(m_files[file_nr], m_read_mode == Direct);
+
+    m_open_files.push_back(file_nr);
+    if (m_open_files.size() > max_open_files) {
+      m_file_readers[m_open_files.front()].reset();
+      m_open_files.pop_front();
+    }
+  }
+
+  return file_reader;
+}
+
+// Read the data of a frame, with a positional read, from the mapping of the
+// file in the Mapped mode or with direct reads in the Direct mode: any number
+// of threads may read at once. The frames of the HDF5 datasets not stored as
+// is are read through the library instead, one at a time.
+void FrameLoader::readFrame(unsigned long frame_nr, unsigned char *ptr) const
+{
+  DEB_MEMBER_FUNCT();
+
+  const unsigned int file_nr      = m_index[frame_nr].first;
+  const unsigned long long offset = m_index[frame_nr].second;
+  const size_t mem_size           = getFrameMemSize(m_frame_dim);
+
+  if (m_hdf5_files[file_nr]) {
+    // The offset is the frame number in the dataset
+    m_hdf5_files[file_nr]->readFrame((unsigned long) offset, ptr);
+  } else if (!m_mapped_files.empty()) {
+    const MappedFile &mapped_file = m_mapped_files[file_nr];
+
+    // The file may have been truncated since it was indexed
+    if (offset + mem_size > mapped_file.size())
+      throw LIMA_EXC(CameraPlugin, Error,
+                     "Failed to read frame " + std::to_string(frame_nr) + " of " + m_files[file_nr]);
+
+    // Copy the frame data
+    std::memcpy(ptr, mapped_file.data() + offset, mem_size);
+  } else {
+    std::shared_ptr<const FileReader> file_reader = getFileReader(file_nr);
+
+    // Read the frame data
+    if (offset + mem_size > file_reader->size())
+      throw LIMA_EXC(CameraPlugin, Error,
+                     "Failed to read frame " + std::to_string(frame_nr) + " of " + m_files[file_nr]);
+    if (file_reader->isDirect())
+      readDirect(*file_reader, offset, ptr, mem_size);
+    else
+      file_reader->read(offset, ptr, mem_size);
+  }
+}
+
+// Read a range of a file opened for direct reads. The data section of an EDF
+// frame follows a header of any size, so the aligned blocks holding the range
+// are read into a staging buffer, taken from a pool, and only the range is
+// copied. The range is read straight into ptr when both are aligned.
+void FrameLoader::readDirect(const FileReader &file_reader, unsigned long long offset, unsigned char *ptr,
+                             size_t size) const
+{
+  const size_t alignment = FileReader::direct_alignment;
+
+  if ((offset % alignment == 0) && (reinterpret_cast<uintptr_t>(ptr) % alignment == 0)) {
+    const size_t aligned_size = size - size % alignment;
+    file_reader.read(offset, ptr, aligned_size);
+    offset += aligned_size;
+    ptr += aligned_size;
+    size -= aligned_size;
+    if (size == 0)
+      return;
+  }
+
+  const unsigned long long begin = offset - offset % alignment;
+  const unsigned long long end   = (offset + size + alignment - 1) / alignment * alignment;
+  const size_t staging_size      = (size + 2 * alignment - 1) / alignment * alignment;
+
+  std::unique_ptr<AlignedBuffer> staging;
+  {
+    std::lock_guard<std::mutex> lock(m_staging_mutex);
+    if (!m_staging_buffers.empty()) {
+      staging = std::move(m_staging_buffers.back());
+      m_staging_buffers.pop_back();
+    }
+  }
+  if (!staging || (staging->size() < staging_size))
+    staging.reset(new AlignedBuffer(staging_size));
+
+  file_reader.read(begin, staging->data(), size_t(end - begin));
+  std::memcpy(ptr, staging->data() + (offset - begin), size);
+
+  std::lock_guard<std::mutex> lock(m_staging_mutex);
+  m_staging_buffers.push_back(std::move(staging));
+}
+
+// Start the reader thread, reading ahead from the first frame
+void FrameLoader::startReader()
+{
+  DEB_MEMBER_FUNCT();
+
+  const size_t mem_size = getFrameMemSize(m_frame_dim);
+  m_ring.resize(m_read_ahead_depth);
+  for (buffer_t &buffer : m_ring)
+    buffer = buffer_t(new unsigned char[mem_size]);
+
+  m_ring_first   = 0;
+  m_ring_ready   = 0;
+  m_reader_busy  = false;
+  m_reader_stop  = false;
+  m_reader_error.clear();
+  m_nb_stalls    = 0;
+  m_bytes_read   = 0;
+  m_read_start   = std::chrono::steady_clock::now();
+  m_read_end     = m_read_start;
+
+  m_reader = std::thread(&FrameLoader::readAhead, this);
+}
+
+// Stop the reader thread, if running, and release the ring
+void FrameLoader::stopReader()
+{
+  if (!m_reader.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_ring_mutex);
+    m_reader_stop = true;
+  }
+  m_ring_cond.notify_all();
+  m_reader.join();
+
+  m_ring.clear();
+}
+
+// The reader thread: fill the ring with the frames following the next
+// expected one, until the end of the files or an error
+void FrameLoader::readAhead()
+{
+  DEB_MEMBER_FUNCT();
+
+  const size_t mem_size = getFrameMemSize(m_frame_dim);
+  const size_t depth    = m_ring.size();
+
+  std::unique_lock<std::mutex> lock(m_ring_mutex);
+  while (!m_reader_stop) {
+    if ((m_ring_ready >= m_index.size()) || (m_ring_ready - m_ring_first >= depth) || !m_reader_error.empty()) {
+      m_ring_cond.wait(lock);
+      continue;
+    }
+
+    // The slot is not used by getFrame() while the frame is being read
+    const unsigned long frame_nr = m_ring_ready;
+    m_reader_busy                = true;
+    lock.unlock();
+
+    std::string error;
+    try {
+      readFrame(frame_nr, m_ring[frame_nr % depth].get());
+    } catch (Exception &e) {
+      error = e.getErrMsg();
+    }
+
+    lock.lock();
+    m_reader_busy = false;
+    // getFrame() may have restarted the ring meanwhile
+    if (frame_nr == m_ring_ready) {
+      if (error.empty()) {
+        m_ring_ready++;
+        m_bytes_read += mem_size;
+        m_read_end = std::chrono::steady_clock::now();
+      } else
+        m_reader_error = error;
+    }
+    m_ring_cond.notify_all();
+  }
+}
+
+// Copy a frame from the ring, waiting for the reader if needed. The ring
+// follows a single sequence of frames, the calls are serialized.
+void FrameLoader::getReadAheadFrame(unsigned long frame_nr, unsigned char *ptr)
+{
+  DEB_MEMBER_FUNCT();
+
+  std::lock_guard<std::mutex> get_lock(m_ring_get_mutex);
+  std::unique_lock<std::mutex> lock(m_ring_mutex);
+
+  if (frame_nr != m_ring_first) {
+    DEB_TRACE() << "Restart reading ahead from " << frame_nr;
+
+    // Wait for the frame being read, its slot may be reused
+    while (m_reader_busy)
+      m_ring_cond.wait(lock);
+    m_ring_first = frame_nr;
+    m_ring_ready = frame_nr;
+    m_reader_error.clear();
+    m_ring_cond.notify_all();
+  }
+
+  if (m_ring_ready == m_ring_first) {
+    m_nb_stalls++;
+    while ((m_ring_ready == m_ring_first) && m_reader_error.empty())
+      m_ring_cond.wait(lock);
+    if (m_ring_ready == m_ring_first)
+      throw LIMA_EXC(CameraPlugin, Error, m_reader_error);
+  }
+
+  // The reader does not write the slot until the frame is released
+  const unsigned char *src = m_ring[frame_nr % m_ring.size()].get();
+  lock.unlock();
+  std::memcpy(ptr, src, getFrameMemSize(m_frame_dim));
+  lock.lock();
+
+  m_ring_first++;
+  m_ring_cond.notify_all();
+}
@@ -0,0 +1,272 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <mutex>
+
+#if defined(SIMULATOR_WITH_HDF5)
+#include <hdf5.h>
+// The chunk addresses are available since 1.10.5
+#if H5_VERSION_GE(1, 10, 5)
+#define SIMULATOR_WITH_HDF5_CHUNK_INFO
+#endif
+#endif // SIMULATOR_WITH_HDF5
+
+#include "lima/Exceptions.h"
+
+#include "simulator/SimulatorFrameGetter.h"
+#include "simulator/SimulatorHdf5File.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+using namespace std;
+
+#if defined(SIMULATOR_WITH_HDF5)
+
+// Serializes the calls to the library
+static mutex hdf5_mutex;
+
+// Get the image type and the native type of the pixels of a dataset type
+static void getPixelType(hid_t type, ImageType &image_type, hid_t &mem_type)
+{
+  const H5T_class_t type_class = H5Tget_class(type);
+  const size_t size            = H5Tget_size(type);
+  const bool is_signed         = (type_class == H5T_INTEGER) && (H5Tget_sign(type) == H5T_SGN_2);
+
+  if ((type_class == H5T_INTEGER) && (size == 1)) {
+    image_type = is_signed ? Bpp8S : Bpp8;
+    mem_type   = is_signed ? H5T_NATIVE_INT8 : H5T_NATIVE_UINT8;
+  } else if ((type_class == H5T_INTEGER) && (size == 2)) {
+    image_type = is_signed ? Bpp16S : Bpp16;
+    mem_type   = is_signed ? H5T_NATIVE_INT16 : H5T_NATIVE_UINT16;
+  } else if ((type_class == H5T_INTEGER) && (size == 4)) {
+    image_type = is_signed ? Bpp32S : Bpp32;
+    mem_type   = is_signed ? H5T_NATIVE_INT32 : H5T_NATIVE_UINT32;
+  } else if ((type_class == H5T_FLOAT) && (size == 4)) {
+    image_type = Bpp32F;
+    mem_type   = H5T_NATIVE_FLOAT;
+  } else
+    throw LIMA_EXC(CameraPlugin, Error, "Unsupported pixel type in HDF5 file");
+}
+
+#endif // SIMULATOR_WITH_HDF5
+
+Hdf5File::Hdf5File() :
+  m_file(-1), m_dataset(-1), m_mem_type(-1), m_rank(0), m_layout(Encoded), m_offset(0), m_nb_frames(0)
+{
+}
+
+Hdf5File::Hdf5File(const string &path, const string &dataset) :
+  m_file(-1), m_dataset(-1), m_mem_type(-1), m_rank(0), m_layout(Encoded), m_offset(0), m_nb_frames(0)
+{
+  open(path, dataset);
+}
+
+Hdf5File::~Hdf5File()
+{
+  close();
+}
+
+/**
+ * @brief Opens a dataset of frames, closing the previous one
+ *
+ * @param[in] path     std::string the file name
+ * @param[in] dataset  std::string the path of the dataset in the
+ *file, i.e. /entry_0000/measurement/data
+ *******************************************************************/
+void Hdf5File::open(const string &path, const string &dataset)
+{
+  close();
+
+#if defined(SIMULATOR_WITH_HDF5)
+  lock_guard<mutex> lock(hdf5_mutex);
+
+  hid_t file = -1, dset = -1;
+  H5E_BEGIN_TRY
+  {
+    file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file >= 0)
+      dset = H5Dopen2(file, dataset.c_str(), H5P_DEFAULT);
+  }
+  H5E_END_TRY;
+  if (file < 0)
+    throw LIMA_EXC(CameraPlugin, Error, "Failed to open HDF5 file " + path);
+  if (dset < 0) {
+    H5Fclose(file);
+    throw LIMA_EXC(CameraPlugin, Error, "Dataset " + dataset + " not found in " + path);
+  }
+
+  hid_t space = H5Dget_space(dset);
+  hid_t type  = H5Dget_type(dset);
+  hid_t plist = H5Dget_create_plist(dset);
+
+  try {
+    // A single frame or a stack of frames
+    hsize_t dims[3];
+    const int rank = H5Sget_simple_extent_ndims(space);
+    if ((rank != 2) && (rank != 3))
+      throw LIMA_EXC(CameraPlugin, Error, "Unsupported rank of dataset " + dataset + " in " + path);
+    H5Sget_simple_extent_dims(space, dims, NULL);
+
+    ImageType image_type;
+    hid_t mem_type;
+    getPixelType(type, image_type, mem_type);
+
+    m_rank      = rank;
+    m_nb_frames = (rank == 3) ? (unsigned long) dims[0] : 1;
+    m_frame_dim = FrameDim(int(dims[rank - 1]), int(dims[rank - 2]), image_type);
+    m_mem_type  = mem_type;
+
+    // The frames are stored as is if the pixels are native and not
+    // filtered, and if each frame is contiguous in the file
+    m_layout = Encoded;
+    if (H5Tequal(type, mem_type) > 0) {
+      const H5D_layout_t layout = H5Pget_layout(plist);
+      if ((layout == H5D_CONTIGUOUS) && (H5Pget_external_count(plist) == 0)) {
+        const haddr_t offset = H5Dget_offset(dset);
+        if (offset != HADDR_UNDEF) {
+          m_layout = Contiguous;
+          m_offset = (unsigned long long) offset;
+        }
+      }
+#if defined(SIMULATOR_WITH_HDF5_CHUNK_INFO)
+      hsize_t chunk_dims[3];
+      if ((layout == H5D_CHUNKED) && (H5Pget_nfilters(plist) == 0) && (H5Pget_chunk(plist, rank, chunk_dims) == rank) &&
+          ((rank == 2) || (chunk_dims[0] == 1)) && (chunk_dims[rank - 2] == dims[rank - 2]) &&
+          (chunk_dims[rank - 1] == dims[rank - 1]))
+        m_layout = Chunked;
+#endif
+    }
+  } catch (...) {
+    H5Pclose(plist);
+    H5Tclose(type);
+    H5Sclose(space);
+    H5Dclose(dset);
+    H5Fclose(file);
+    throw;
+  }
+
+  H5Pclose(plist);
+  H5Tclose(type);
+  H5Sclose(space);
+
+  m_file    = file;
+  m_dataset = dset;
+#else
+  throw LIMA_EXC(CameraPlugin, NotSupported, "HDF5 support not compiled in, cannot open " + path);
+#endif // SIMULATOR_WITH_HDF5
+}
+
+/**
+ * @brief Closes the dataset, if open
+ *******************************************************************/
+void Hdf5File::close()
+{
+  if (!isOpen())
+    return;
+
+#if defined(SIMULATOR_WITH_HDF5)
+  lock_guard<mutex> lock(hdf5_mutex);
+  H5Dclose(m_dataset);
+  H5Fclose(m_file);
+#endif // SIMULATOR_WITH_HDF5
+
+  m_file      = -1;
+  m_dataset   = -1;
+  m_mem_type  = -1;
+  m_nb_frames = 0;
+}
+
+/**
+ * @brief Gets the offset in the file of the data of a frame stored
+ *as is
+ *
+ * @param[in]  frame_nr  unsigned long the frame number in the dataset
+ * @param[out] offset    unsigned long long in bytes
+ *
+ * @return false if the frame must be read with readFrame(): the
+ *frame is filtered (compressed), spread over several chunks, not
+ *allocated or its pixels are not native
+ *******************************************************************/
+bool Hdf5File::getFrameOffset(unsigned long frame_nr, unsigned long long &offset) const
+{
+  const size_t mem_size = getFrameMemSize(m_frame_dim);
+
+  switch (m_layout) {
+  case Contiguous:
+    offset = m_offset + (unsigned long long) frame_nr * mem_size;
+    return true;
+
+  case Chunked: {
+#if defined(SIMULATOR_WITH_HDF5_CHUNK_INFO)
+    lock_guard<mutex> lock(hdf5_mutex);
+    hsize_t coords[3] = {frame_nr, 0, 0};
+    unsigned filter_mask;
+    haddr_t address;
+    hsize_t size;
+    if ((H5Dget_chunk_info_by_coord(m_dataset, (m_rank == 3) ? coords : coords + 1, &filter_mask, &address, &size) <
+         0) ||
+        (address == HADDR_UNDEF) || (size != mem_size))
+      return false;
+    offset = (unsigned long long) address;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief Reads a frame through the HDF5 library, which decodes the
+ *filtered (compressed) chunks
+ *
+ * @param[in] frame_nr  unsigned long the frame number in the dataset
+ * @param[in] ptr       an (unsigned char) pointer to an allocated
+ *buffer
+ *******************************************************************/
+void Hdf5File::readFrame(unsigned long frame_nr, unsigned char *ptr) const
+{
+#if defined(SIMULATOR_WITH_HDF5)
+  lock_guard<mutex> lock(hdf5_mutex);
+
+  const Size &size        = m_frame_dim.getSize();
+  hsize_t start[3]        = {frame_nr, 0, 0};
+  hsize_t count[3]        = {1, hsize_t(size.getHeight()), hsize_t(size.getWidth())};
+  const int offset        = (m_rank == 3) ? 0 : 1;
+
+  hid_t file_space = H5Dget_space(m_dataset);
+  hid_t mem_space  = H5Screate_simple(2, count + 1, NULL);
+  herr_t res       = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start + offset, NULL, count + offset, NULL);
+  if (res >= 0)
+    res = H5Dread(m_dataset, m_mem_type, mem_space, file_space, H5P_DEFAULT, ptr);
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+
+  if (res < 0)
+    throw LIMA_EXC(CameraPlugin, Error, "Failed to read HDF5 dataset");
+#else
+  throw LIMA_EXC(CameraPlugin, NotSupported, "HDF5 support not compiled in");
+#endif // SIMULATOR_WITH_HDF5
+}
@@ -0,0 +1,209 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "lima/Exceptions.h"
+
+#include "simulator/SimulatorMappedFile.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+using namespace std;
+
+MappedFile::MappedFile() : m_data(NULL), m_size(0), m_is_open(false) {}
+
+MappedFile::MappedFile(const string &path) : m_data(NULL), m_size(0), m_is_open(false)
+{
+  open(path);
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile(MappedFile &&o) : m_data(o.m_data), m_size(o.m_size), m_is_open(o.m_is_open)
+{
+  o.m_data    = NULL;
+  o.m_size    = 0;
+  o.m_is_open = false;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&o)
+{
+  if (this != &o) {
+    close();
+    swap(m_data, o.m_data);
+    swap(m_size, o.m_size);
+    swap(m_is_open, o.m_is_open);
+  }
+  return *this;
+}
+
+/**
+ * @brief Maps a whole file, read-only, unmapping the previous one
+ *
+ * @param[in] path  std::string the file name
+ *******************************************************************/
+void MappedFile::open(const string &path)
+{
+  close();
+
+  ostringstream msg;
+  msg << "Failed to map file " << path << ": ";
+
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    msg << "error " << GetLastError();
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    msg << "error " << GetLastError();
+    CloseHandle(file);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  // An empty file cannot be mapped
+  if (size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data     = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data)
+      msg << "error " << GetLastError();
+    // The view keeps a reference to the mapping
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    if (!data)
+      throw LIMA_EXC(CameraPlugin, Error, msg.str());
+    m_data = static_cast<const unsigned char *>(data);
+  } else
+    CloseHandle(file);
+
+  m_size = size_t(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    msg << strerror(errno);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    msg << strerror(errno);
+    ::close(fd);
+    throw LIMA_EXC(CameraPlugin, Error, msg.str());
+  }
+
+  // An empty file cannot be mapped
+  if (st.st_size > 0) {
+    void *data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      msg << strerror(errno);
+      ::close(fd);
+      throw LIMA_EXC(CameraPlugin, Error, msg.str());
+    }
+    m_data = static_cast<const unsigned char *>(data);
+  }
+
+  // The mapping keeps a reference to the file
+  ::close(fd);
+
+  m_size = size_t(st.st_size);
+#endif // _WIN32
+
+  m_is_open = true;
+}
+
+/**
+ * @brief Unmaps the file, if any
+ *******************************************************************/
+void MappedFile::close()
+{
+  if (m_data) {
+#if defined(_WIN32)
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif // _WIN32
+  }
+
+  m_data    = NULL;
+  m_size    = 0;
+  m_is_open = false;
+}
+
+/**
+ * @brief Tells the kernel how a range of the file will be read
+ *
+ * The hint is ignored on Windows, and the range is clipped to the
+ *file.
+ *
+ * @param[in] advice  Advice
+ * @param[in] offset  size_t first byte of the range
+ * @param[in] length  size_t of the range in bytes, up to the end of
+ *the file by default
+ *******************************************************************/
+void MappedFile::advise(Advice advice, size_t offset, size_t length) const
+{
+#if !defined(_WIN32)
+  if (!m_data || (offset >= m_size))
+    return;
+  length = min(length, m_size - offset);
+
+  // The range must start on a page boundary
+  const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+  const size_t start     = offset - offset % page_size;
+
+  int flag;
+  switch (advice) {
+  case Sequential:
+    flag = MADV_SEQUENTIAL;
+    break;
+  case WillNeed:
+    flag = MADV_WILLNEED;
+    break;
+  default:
+    flag = MADV_NORMAL;
+  }
+
+  // A hint: a failure is harmless
+  madvise(const_cast<unsigned char *>(m_data) + start, length + (offset - start), flag);
+#endif // !_WIN32
+}
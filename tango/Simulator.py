@@ -31,6 +31,9 @@ from Lima.Server import AttrHelper
 from Lima import Core
 from Lima import Simulator as SimuMod
 
+# Maximum number of Gauss peaks, the frame builder indexes them in a grid
+MAX_NB_PEAKS = 100000
+
 def grouper(n, iterable, padvalue=None):
     return zip(*[itertools.chain(iterable, itertools.repeat(padvalue, n-1))]*n)
 
@@ -63,6 +66,24 @@ class Simulator(PyTango.Device_4Impl):
         'GAUSS':       SimuMod.FrameBuilder.Gauss,
         'DIFFRACTION': SimuMod.FrameBuilder.Diffraction,
         'EMPTY':       SimuMod.FrameBuilder.Empty,
+        'PHOTONS':     SimuMod.FrameBuilder.Photons,
+	}
+
+    _BinningMode = {
+        'SAMPLED':    SimuMod.FrameBuilder.Sampled,
+        'INTEGRATED': SimuMod.FrameBuilder.Integrated,
+	}
+
+    _RenderMode = {
+        'REFERENCE': SimuMod.FrameBuilder.Reference,
+        'SEPARABLE': SimuMod.FrameBuilder.Separable,
+        'SPRITE': SimuMod.FrameBuilder.Sprite,
+	}
+
+    _ReadMode = {
+        'STREAMED': SimuMod.FrameLoader.Streamed,
+        'MAPPED':   SimuMod.FrameLoader.Mapped,
+        'DIRECT':   SimuMod.FrameLoader.Direct,
 	}
 
     Core.DEB_CLASS(Core.DebModApplication, 'LimaSimulator')
@@ -78,6 +99,9 @@ class Simulator(PyTango.Device_4Impl):
         self.__Mode = self._Mode
         self.__RotationAxis = self._RotationAxis
         self.__FillType = self._FillType
+        self.__RenderMode = self._RenderMode
+        self.__BinningMode = self._BinningMode
+        self.__ReadMode = self._ReadMode
 
         # Load the properties
         self.get_device_properties(self.get_device_class())
@@ -203,6 +227,25 @@ class Simulator(PyTango.Device_4Impl):
         sx, sy = attr.get_write_value()
         self._SimuCamera.getFrameGetter().setDiffractionSpeed(sx, sy)
 
+    def read_module_layout(self,attr) :
+        module_size, gap_size, nb_x, nb_y = self._SimuCamera.getFrameGetter().getModuleLayout()
+        attr.set_value((module_size.getWidth(), module_size.getHeight(),
+                        gap_size.getWidth(), gap_size.getHeight(), nb_x, nb_y))
+
+    def write_module_layout(self,attr) :
+        width, height, gap_x, gap_y, nb_x, nb_y = attr.get_write_value()
+        self._SimuCamera.getFrameGetter().setModuleLayout(Core.Size(width, height),
+                                                          Core.Size(gap_x, gap_y),
+                                                          nb_x, nb_y)
+
+    def read_tile_size(self,attr) :
+        width, height = self._SimuCamera.getFrameGetter().getTileSize()
+        attr.set_value((width, height))
+
+    def write_tile_size(self,attr) :
+        width, height = attr.get_write_value()
+        self._SimuCamera.getFrameGetter().setTileSize(width, height)
+
     def read_nb_prefetched_frames(self,attr) :
         if (self._SimuCamera.getMode() == SimuMod.Camera.MODE_GENERATOR_PREFETCH) or \
            (self._SimuCamera.getMode() == SimuMod.Camera.MODE_LOADER_PREFETCH) :
@@ -221,6 +264,16 @@ class Simulator(PyTango.Device_4Impl):
         frame_dim = self.getFrameDimFromLongArray(dim_arr)
         self._SimuCamera.setFrameDim(frame_dim)
 
+    def read_raw_frame_dim(self,attr) :
+        frame_dim = self._SimuCamera.getFrameGetter().getRawFrameDim()
+        dim_arr = self.getLongArrayFromFrameDim(frame_dim)
+        attr.set_value(dim_arr)
+
+    def write_raw_frame_dim(self,attr) :
+        dim_arr = attr.get_write_value()
+        frame_dim = self.getFrameDimFromLongArray(dim_arr)
+        self._SimuCamera.getFrameGetter().setRawFrameDim(frame_dim)
+
 class SimulatorClass(PyTango.DeviceClass):
 
     class_property_list = {}
@@ -246,7 +299,7 @@ class SimulatorClass(PyTango.DeviceClass):
          "Base rotation angle for each peak",[]],
         'fill_type':
         [PyTango.DevString,
-         "Image fill type: GAUSS, DIFFRACTION",[]],
+         "Image fill type: GAUSS, DIFFRACTION, EMPTY, PHOTONS",[]],
         'rotation_axis':
         [PyTango.DevString,
          "Peak move policy: STATIC, ROTATIONX, ROTATIONY",[]],
@@ -269,6 +322,10 @@ class SimulatorClass(PyTango.DeviceClass):
         [[PyTango.DevString,
           PyTango.SCALAR,
           PyTango.READ_WRITE]],
+        'packed_bits':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
         # Simulator with prefetch
         'nb_prefetched_frames':
         [[PyTango.DevLong,
@@ -279,15 +336,47 @@ class SimulatorClass(PyTango.DeviceClass):
         [[PyTango.DevString,
           PyTango.SCALAR,
           PyTango.WRITE]],
+        'dataset_path':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'raw_frame_dim':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE, 3]],
+        'index_file':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'read_mode':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'read_ahead_depth':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'read_ahead_level':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'read_ahead_stalls':
+        [[PyTango.DevULong64,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'read_ahead_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ]],
         # Simulator in generator mode
         'peaks':
         [[PyTango.DevDouble,
           PyTango.SPECTRUM,
-          PyTango.READ_WRITE, 4000]],
+          PyTango.READ_WRITE, 4 * MAX_NB_PEAKS]],
         'peak_angles':
         [[PyTango.DevDouble,
           PyTango.SPECTRUM,
-          PyTango.READ_WRITE, 1000]],
+          PyTango.READ_WRITE, MAX_NB_PEAKS]],
         'grow_factor':
         [[PyTango.DevDouble,
           PyTango.SCALAR,
@@ -296,6 +385,46 @@ class SimulatorClass(PyTango.DeviceClass):
         [[PyTango.DevString,
           PyTango.SCALAR,
           PyTango.READ_WRITE]],
+        'render_mode':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'binning_mode':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'peak_cutoff':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'nb_threads':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'pin_threads':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'tile_size':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE, 2]],
+        'shot_noise':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'read_noise':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'dark_offset':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'noise_seed':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
         'rotation_axis':
         [[PyTango.DevString,
           PyTango.SCALAR,
@@ -304,6 +433,30 @@ class SimulatorClass(PyTango.DeviceClass):
         [[PyTango.DevDouble,
           PyTango.SPECTRUM,
           PyTango.READ_WRITE, 2]],
+        'module_layout':
+        [[PyTango.DevLong,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE, 6]],
+        'gap_value':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'module_order':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'frame_cache_size':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'frame_cache_hits':
+        [[PyTango.DevULong64,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'frame_cache_misses':
+        [[PyTango.DevULong64,
+          PyTango.SCALAR,
+          PyTango.READ]],
         'diffraction_speed':
         [[PyTango.DevDouble,
           PyTango.SPECTRUM,
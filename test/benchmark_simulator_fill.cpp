@@ -0,0 +1,108 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Measures the frame rate of each specialized fill function (fill type, depth,
+// binning, RoI) with the Reference, the default (Separable) and the Sprite
+// render modes.
+//
+// Usage: benchmark_simulator_fill [width height [nb_frames]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static double measure(FrameBuilder &fb, int nb_frames)
+{
+  FrameDim frame_dim;
+  fb.getEffectiveFrameDim(frame_dim);
+  std::vector<unsigned char> buffer(frame_dim.getMemSize());
+
+  fb.prepareAcq();
+  fb.getFrame(0, buffer.data()); // warm-up
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame_nr = 1; frame_nr <= nb_frames; frame_nr++)
+    fb.getFrame(frame_nr, buffer.data());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return nb_frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+  int width     = (argc > 2) ? atoi(argv[1]) : 512;
+  int height    = (argc > 2) ? atoi(argv[2]) : 512;
+  int nb_frames = (argc > 3) ? atoi(argv[3]) : 4;
+
+  static const char *fill_names[] = {"Gauss", "Diffraction"};
+  ImageType image_types[]         = {Bpp8, Bpp16, Bpp32};
+  int bins[]                      = {1, 2, 3};
+
+  try {
+    printf("%-12s %5s %5s %4s %12s %12s %9s %12s %9s\n", "fill", "depth", "bin", "roi", "ref. fps", "fps", "speedup",
+           "sprite fps", "speedup");
+
+    for (int fill_type = FrameBuilder::Gauss; fill_type <= FrameBuilder::Diffraction; fill_type++)
+      for (ImageType image_type : image_types)
+        for (int bin : bins)
+          for (int roi = 0; roi < 2; roi++) {
+            double fps[3];
+            for (int mode = FrameBuilder::Reference; mode <= FrameBuilder::Sprite; mode++) {
+              FrameBuilder fb;
+              FrameBuilder::PeakList peaks;
+              peaks.push_back(GaussPeak(width / 4, height / 4, 20, 1000));
+              peaks.push_back(GaussPeak(width / 2, height / 2, 50, 100));
+              peaks.push_back(GaussPeak(3 * width / 4, height / 3, 8, 5000));
+
+              fb.setFrameDim(FrameDim(width, height, image_type));
+              // Any bin other than 1 or 2 needs the Integrated binning mode
+              if (bin > 2)
+                fb.setBinningMode(FrameBuilder::Integrated);
+              fb.setBin(Bin(bin, bin));
+              if (roi)
+                fb.setRoi(Roi(Point(width / bin / 4, height / bin / 4), Size(width / bin / 2, height / bin / 2)));
+              fb.setPeaks(peaks);
+              fb.setFillType(FrameBuilder::FillType(fill_type));
+              fb.setRenderMode(FrameBuilder::RenderMode(mode));
+              fb.setDiffractionPos(width / 2, height / 2);
+              fb.setRotationSpeed(1);
+
+              fps[mode] = measure(fb, nb_frames);
+            }
+
+            printf("%-12s %5d %5d %4s %12.1f %12.1f %8.1fx %12.1f %8.1fx\n", fill_names[fill_type],
+                   FrameDim::getImageTypeDepth(image_type), bin, roi ? "yes" : "no", fps[0], fps[1], fps[1] / fps[0], fps[2],
+                   fps[2] / fps[0]);
+          }
+  } catch (Exception &e) {
+    fprintf(stderr, "%s\n", e.getErrMsg().c_str());
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,258 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Measures the frame rate of the FrameLoader reading EDF files with positional
+// reads (Streamed), from memory mappings (Mapped) or bypassing the page cache
+// (Direct), synchronously or read ahead by a background thread, with the files
+// evicted from the page cache (cold) or already cached (warm). Each frame may
+// be delayed by an exposure time, as in the acquisition loop, which the reads
+// ahead overlap. On Linux, also reports the resident memory of the process at
+// the end of the cold replay and how much the page cache grew during it. Then
+// measures the time to prefetch all the frames with one thread and with all
+// the OpenMP threads, the frames being read concurrently across the files.
+//
+// Usage: benchmark_simulator_loader [width height [nb_frames [directory [exposure_us]]]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include "simulator/SimulatorFrameLoader.h"
+#include "simulator/SimulatorFramePrefetcher.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int nb_files = 4;
+
+static std::string fileName(const std::string &directory, int file_nr)
+{
+  return directory + "/benchmark_simulator_loader_" + std::to_string(file_nr) + ".edf";
+}
+
+// Writes the frames, a 512-byte header and the data each, spread over nb_files files
+static void writeFiles(const std::string &directory, int width, int height, int nb_frames)
+{
+  std::string header = "{\nHeaderID = EH:000001:000000:000000 ;\nByteOrder = LowByteFirst ;\n"
+                       "DataType = UnsignedShort ;\nDim_1 = " +
+                       std::to_string(width) + " ;\nDim_2 = " + std::to_string(height) +
+                       " ;\nSize = " + std::to_string(size_t(width) * height * 2) + " ;\n";
+  header.resize(510, ' ');
+  header += "}\n";
+
+  std::vector<unsigned short> data(size_t(width) * height);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (unsigned short) i;
+
+  for (int file_nr = 0; file_nr < nb_files; file_nr++) {
+    FILE *file = fopen(fileName(directory, file_nr).c_str(), "wb");
+    if (!file)
+      throw LIMA_EXC(CameraPlugin, Error, "Failed to create " + fileName(directory, file_nr));
+    for (int frame_nr = file_nr; frame_nr < nb_frames; frame_nr += nb_files) {
+      fwrite(header.data(), 1, header.size(), file);
+      fwrite(data.data(), sizeof(unsigned short), data.size(), file);
+    }
+    fclose(file);
+  }
+}
+
+// Evicts the files from the page cache, returns false if not supported
+static bool evictFiles(const std::string &directory)
+{
+#if defined(_WIN32)
+  return false;
+#else
+  for (int file_nr = 0; file_nr < nb_files; file_nr++) {
+    int fd = open(fileName(directory, file_nr).c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+  return true;
+#endif
+}
+
+// Returns the resident memory of the process in MB, 0 if unknown
+static double residentMB()
+{
+  double resident_mb = 0;
+#if defined(__linux__)
+  FILE *file = fopen("/proc/self/statm", "r");
+  unsigned long size, resident;
+  if (file && (fscanf(file, "%lu %lu", &size, &resident) == 2))
+    resident_mb = double(resident) * sysconf(_SC_PAGESIZE) / (1 << 20);
+  if (file)
+    fclose(file);
+#endif
+  return resident_mb;
+}
+
+// Returns the size of the page cache in MB, 0 if unknown
+static double pageCacheMB()
+{
+  double cached_mb = 0;
+#if defined(__linux__)
+  FILE *file = fopen("/proc/meminfo", "r");
+  char line[256];
+  unsigned long cached_kb;
+  while (file && fgets(line, sizeof(line), file))
+    if (sscanf(line, "Cached: %lu kB", &cached_kb) == 1) {
+      cached_mb = cached_kb / 1024.;
+      break;
+    }
+  if (file)
+    fclose(file);
+#endif
+  return cached_mb;
+}
+
+static double measure(FrameLoader::ReadMode read_mode, unsigned int depth, const std::string &directory, int nb_frames,
+                      int exposure_us, bool cold, unsigned long &nb_stalls, double &resident_mb, double &cache_mb)
+{
+  FrameLoader fl;
+  fl.setFilePattern(directory + "/benchmark_simulator_loader_*.edf");
+  fl.setReadMode(read_mode);
+  fl.setReadAheadDepth(depth);
+
+  FrameDim frame_dim;
+  fl.getEffectiveFrameDim(frame_dim);
+  std::vector<unsigned char> buffer(getFrameMemSize(frame_dim));
+
+  if (cold && !evictFiles(directory))
+    return 0;
+
+  double start_cache_mb = pageCacheMB();
+  auto start            = std::chrono::steady_clock::now();
+  fl.prepareAcq();
+  for (int frame_nr = 0; frame_nr < nb_frames; frame_nr++) {
+    if (exposure_us)
+      std::this_thread::sleep_for(std::chrono::microseconds(exposure_us));
+    fl.getFrame(frame_nr, buffer.data());
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  fl.getReadAheadStalls(nb_stalls);
+  resident_mb = residentMB();
+  cache_mb    = pageCacheMB() - start_cache_mb;
+  return nb_frames / elapsed.count();
+}
+
+static double measurePrefetch(FrameLoader::ReadMode read_mode, const std::string &directory, int nb_frames,
+                              int nb_threads, bool cold)
+{
+#if defined(_OPENMP)
+  omp_set_num_threads(nb_threads);
+#endif
+
+  FramePrefetcher<FrameLoader> fp;
+  fp.setFilePattern(directory + "/benchmark_simulator_loader_*.edf");
+  fp.setReadMode(read_mode);
+  fp.setNbPrefetchedFrames(nb_frames);
+
+  if (cold && !evictFiles(directory))
+    return 0;
+
+  auto start = std::chrono::steady_clock::now();
+  fp.prepareAcq();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+  int width             = (argc > 2) ? atoi(argv[1]) : 1024;
+  int height            = (argc > 2) ? atoi(argv[2]) : 1024;
+  int nb_frames         = (argc > 3) ? atoi(argv[3]) : 200;
+  std::string directory = (argc > 4) ? argv[4] : ".";
+  int exposure_us       = (argc > 5) ? atoi(argv[5]) : 0;
+
+  static const char *mode_names[] = {"Streamed", "Mapped", "Direct"};
+  unsigned int depths[]           = {0, 16};
+
+  try {
+    writeFiles(directory, width, height, nb_frames);
+
+    printf("%-10s %6s %12s %12s %10s %10s %12s %12s\n", "mode", "depth", "cold fps", "cold stalls", "RSS MB",
+           "cache MB", "warm fps", "warm GB/s");
+
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++)
+      for (unsigned int depth : depths) {
+        FrameLoader::ReadMode mode = FrameLoader::ReadMode(read_mode);
+        unsigned long cold_stalls, warm_stalls;
+        double resident_mb, cache_mb, warm_resident_mb, warm_cache_mb;
+        double cold_fps =
+            measure(mode, depth, directory, nb_frames, exposure_us, true, cold_stalls, resident_mb, cache_mb);
+        measure(mode, depth, directory, nb_frames, exposure_us, false, warm_stalls, warm_resident_mb,
+                warm_cache_mb); // warm-up
+        double warm_fps =
+            measure(mode, depth, directory, nb_frames, exposure_us, false, warm_stalls, warm_resident_mb, warm_cache_mb);
+
+        printf("%-10s %6u %12.1f %12lu %10.1f %10.1f %12.1f %12.2f\n", mode_names[read_mode], depth, cold_fps,
+               cold_stalls, resident_mb, cache_mb, warm_fps, warm_fps * width * height * 2 / 1e9);
+      }
+
+#if defined(_OPENMP)
+    const int max_threads = omp_get_max_threads();
+#else
+    const int max_threads = 1;
+#endif
+
+    printf("\n%-10s %8s %12s %12s %9s\n", "prefetch", "threads", "cold s", "warm s", "speedup");
+
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++) {
+      FrameLoader::ReadMode mode = FrameLoader::ReadMode(read_mode);
+      double serial_s = 0;
+      for (int nb_threads : {1, max_threads}) {
+        double cold_s = measurePrefetch(mode, directory, nb_frames, nb_threads, true);
+        double warm_s = measurePrefetch(mode, directory, nb_frames, nb_threads, false);
+        if (nb_threads == 1)
+          serial_s = cold_s;
+
+        printf("%-10s %8d %12.3f %12.3f %8.1fx\n", mode_names[read_mode], nb_threads, cold_s, warm_s,
+               serial_s / cold_s);
+      }
+    }
+  } catch (Exception &e) {
+    fprintf(stderr, "%s\n", e.getErrMsg().c_str());
+    return -1;
+  }
+
+  for (int file_nr = 0; file_nr < nb_files; file_nr++)
+    remove(fileName(directory, file_nr).c_str());
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+// Measures the throughput of the 10, 12, 14 and 24-bit packing kernels for
+// each instruction set supported by the CPU, in GB/s of unpacked pixels,
+// compared with a memcpy of the same frame.
+//
+// Usage: benchmark_simulator_pack [mpixels [nb_frames]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "simulator/SimulatorFrameKernels.h"
+
+using namespace lima::Simulator;
+
+template <class T>
+static double measure(void (*pack)(const T *, unsigned char *, int), const std::vector<T> &src,
+                      std::vector<unsigned char> &dst, int nb_frames)
+{
+  int n = int(src.size());
+  pack(src.data(), dst.data(), n); // warm-up
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < nb_frames; i++)
+    pack(src.data(), dst.data(), n);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return double(nb_frames) * n * sizeof(T) / elapsed.count() / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  int mpixels   = (argc > 1) ? atoi(argv[1]) : 4;
+  int nb_frames = (argc > 2) ? atoi(argv[2]) : 50;
+  int n         = mpixels * 1024 * 1024;
+
+  std::vector<unsigned short> src16(n);
+  std::vector<unsigned int> src32(n);
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    src16[i] = (unsigned short)(rand() % 4096);
+    src32[i] = (unsigned int)(rand() % 16777216);
+  }
+  std::vector<unsigned char> dst(size_t(n) * sizeof(unsigned int));
+
+  const char *names[] = {"Scalar", "SSE4", "AVX2", "AVX512"};
+  printf("%8s %9s %9s %9s %9s %9s\n", "", "memcpy", "10-bit", "12-bit", "14-bit", "24-bit");
+
+  FrameKernels::InstructionSet best = FrameKernels::getCpuInstructionSet();
+  for (int isa = FrameKernels::Scalar; isa <= best; isa++) {
+    const FrameKernels &kernels = FrameKernels::get(FrameKernels::InstructionSet(isa));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nb_frames; i++)
+      memcpy(dst.data(), src16.data(), size_t(n) * sizeof(unsigned short));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double memcpy_rate = double(nb_frames) * n * sizeof(unsigned short) / elapsed.count() / 1e9;
+
+    printf("%8s %9.2f %9.2f %9.2f %9.2f %9.2f  GB/s\n", names[isa], memcpy_rate,
+           measure(kernels.pack_10, src16, dst, nb_frames), measure(kernels.pack_12, src16, dst, nb_frames),
+           measure(kernels.pack_14, src16, dst, nb_frames), measure(kernels.pack_24, src32, dst, nb_frames));
+  }
+
+  return 0;
+}
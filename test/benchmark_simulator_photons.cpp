@@ -0,0 +1,114 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Measures the frame rate of the sparse Photons fill type against the dense
+// Gauss fill type, and the rate of the photon event lists alone, at a low
+// occupancy (a few tens of photons per frame).
+//
+// Usage: benchmark_simulator_photons [width height [nb_frames]]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static double measureFrames(FrameBuilder &fb, int nb_frames)
+{
+  FrameDim frame_dim;
+  fb.getEffectiveFrameDim(frame_dim);
+  std::vector<unsigned char> buffer(frame_dim.getMemSize());
+
+  fb.prepareAcq();
+  fb.getFrame(0, buffer.data()); // warm-up
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame_nr = 1; frame_nr <= nb_frames; frame_nr++)
+    fb.getFrame(frame_nr, buffer.data());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return nb_frames / elapsed.count();
+}
+
+static double measureEvents(FrameBuilder &fb, int nb_frames, size_t &nb_photons)
+{
+  FrameBuilder::PhotonList photons;
+
+  fb.prepareAcq();
+  fb.getPhotonEvents(0, photons); // warm-up
+
+  nb_photons = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int frame_nr = 1; frame_nr <= nb_frames; frame_nr++) {
+    fb.getPhotonEvents(frame_nr, photons);
+    nb_photons += photons.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  nb_photons /= nb_frames;
+  return nb_frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+  int width     = (argc > 2) ? atoi(argv[1]) : 256;
+  int height    = (argc > 2) ? atoi(argv[2]) : 256;
+  int nb_frames = (argc > 3) ? atoi(argv[3]) : 2000;
+
+  ImageType image_types[] = {Bpp8, Bpp16, Bpp32};
+
+  try {
+    printf("%5s %8s %12s %12s %12s %9s\n", "depth", "photons", "events fps", "photons fps", "gauss fps", "speedup");
+
+    for (ImageType image_type : image_types) {
+      FrameBuilder fb;
+      FrameBuilder::PeakList peaks;
+      for (int i = 0; i < 20; i++)
+        peaks.push_back(GaussPeak((i * 37) % width, (i * 71) % height, 3, 0.2));
+
+      fb.setFrameDim(FrameDim(width, height, image_type));
+      fb.setPeaks(peaks);
+      fb.setRotationSpeed(1);
+      fb.setGrowFactor(0);
+
+      fb.setFillType(FrameBuilder::Photons);
+      size_t nb_photons;
+      double events_fps  = measureEvents(fb, nb_frames, nb_photons);
+      double photons_fps = measureFrames(fb, nb_frames);
+
+      // The dense fill is much slower, measure fewer frames
+      fb.setFillType(FrameBuilder::Gauss);
+      double gauss_fps = measureFrames(fb, nb_frames / 40 + 1);
+
+      printf("%5d %8zu %12.1f %12.1f %12.1f %8.1fx\n", FrameDim::getImageTypeDepth(image_type), nb_photons, events_fps,
+             photons_fps, gauss_fps, photons_fps / gauss_fps);
+    }
+  } catch (Exception &e) {
+    fprintf(stderr, "%s\n", e.getErrMsg().c_str());
+    return -1;
+  }
+
+  return 0;
+}
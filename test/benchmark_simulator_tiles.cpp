@@ -0,0 +1,113 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+// Measures the scaling of the tiled Gauss renderer with the number of threads
+// (1 to the number of cores) and the frame size (1 to 64 Mpixel), compared
+// with a row by row rendering (1-row tiles as wide as the frame).
+//
+// Usage: benchmark_simulator_tiles [max_mpixels [nb_frames [tile_width tile_height]]]
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static double measure(FrameBuilder &fb, int nb_frames)
+{
+  FrameDim frame_dim;
+  fb.getEffectiveFrameDim(frame_dim);
+  std::vector<unsigned char> buffer(frame_dim.getMemSize());
+
+  fb.prepareAcq();
+  fb.getFrame(0, buffer.data()); // warm-up
+
+  auto start = std::chrono::steady_clock::now();
+  for (int frame_nr = 1; frame_nr <= nb_frames; frame_nr++)
+    fb.getFrame(frame_nr, buffer.data());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return nb_frames / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+  int max_mpixels = (argc > 1) ? atoi(argv[1]) : 64;
+  int nb_frames   = (argc > 2) ? atoi(argv[2]) : 4;
+  int tile_width  = (argc > 4) ? atoi(argv[3]) : 256;
+  int tile_height = (argc > 4) ? atoi(argv[4]) : 64;
+  int nb_cores    = std::max(int(std::thread::hardware_concurrency()), 1);
+
+  // Bragg-like spots, 1000 per Mpixel, rotating so that no frame is cached
+  const int peaks_per_mpixel = 1000;
+
+  try {
+    printf("%8s %7s %12s %12s %9s %9s\n", "Mpixel", "threads", "rows fps", "tiles fps", "speedup", "scaling");
+
+    for (int mpixels = 1; mpixels <= max_mpixels; mpixels *= 4) {
+      int side = 1024;
+      while (side * side < mpixels * 1024 * 1024)
+        side *= 2;
+
+      FrameBuilder::PeakList peaks;
+      srand(1);
+      for (int i = 0; i < peaks_per_mpixel * mpixels; i++)
+        peaks.push_back(GaussPeak(rand() % side, rand() % side, 2 + rand() % 6, 100 + rand() % 5000));
+
+      double tiles_fps_1 = 0;
+      for (int nb_threads = 1;; nb_threads = std::min(nb_threads * 2, nb_cores)) {
+        double fps[2];
+        for (int tiled = 0; tiled < 2; tiled++) {
+          FrameBuilder fb;
+          fb.setFrameDim(FrameDim(side, side, Bpp16));
+          fb.setPeaks(peaks);
+          fb.setRotationSpeed(0.1);
+          fb.setNbThreads(nb_threads);
+          if (tiled)
+            fb.setTileSize(tile_width, tile_height);
+          else
+            fb.setTileSize(INT_MAX, 1);
+          fps[tiled] = measure(fb, nb_frames);
+        }
+        if (nb_threads == 1)
+          tiles_fps_1 = fps[1];
+
+        printf("%8d %7d %12.1f %12.1f %8.1fx %8.1fx\n", side * side >> 20, nb_threads, fps[0], fps[1], fps[1] / fps[0],
+               fps[1] / tiles_fps_1);
+        if (nb_threads == nb_cores)
+          break;
+      }
+    }
+  } catch (Exception &e) {
+    fprintf(stderr, "%s\n", e.getErrMsg().c_str());
+    return -1;
+  }
+
+  return 0;
+}
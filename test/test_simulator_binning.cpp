@@ -0,0 +1,139 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the Integrated binning mode: a frame binned N x N must be the sum of
+// the N x N pixels of the unbinned frame, within 1 LSB, for any bin factor.
+// The frames are float, so that the rounding of the unbinned pixels does not
+// add up. Odd bin factors must only be accepted in the Integrated mode.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int width = 360, height = 240;
+
+static void configure(FrameBuilder &fb, FrameBuilder::RenderMode render_mode, int bin)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.3, 80.7, 12.5, 1000));
+  peaks.push_back(GaussPeak(250.6, 150.2, 3.1, 20000));
+  peaks.push_back(GaussPeak(30.5, 200.5, 40, 500));
+
+  fb.setFrameDim(FrameDim(width, height, Bpp32F));
+  fb.setPeaks(peaks);
+  fb.setGrowFactor(0);
+  fb.setRenderMode(render_mode);
+  fb.setBinningMode(FrameBuilder::Integrated);
+  fb.setBin(Bin(bin, bin));
+}
+
+static bool isBinAccepted(FrameBuilder::BinningMode binning_mode, int bin)
+{
+  FrameBuilder fb;
+  fb.setBinningMode(binning_mode);
+  try {
+    fb.setBin(Bin(bin, bin));
+  } catch (Exception &) {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *render_names[] = {"Reference", "Separable", "Sprite"};
+  int nb_errors                     = 0;
+
+  try {
+    for (int render_mode = FrameBuilder::Separable; render_mode <= FrameBuilder::Sprite; render_mode++) {
+      FrameBuilder unbinned;
+      configure(unbinned, FrameBuilder::RenderMode(render_mode), 1);
+      std::vector<float> pixels(width * height);
+      unbinned.getFrame(0, (unsigned char *)pixels.data());
+
+      for (int bin : {2, 3, 4, 5}) {
+        FrameBuilder binned;
+        configure(binned, FrameBuilder::RenderMode(render_mode), bin);
+
+        FrameDim frame_dim;
+        binned.getEffectiveFrameDim(frame_dim);
+        const int bin_width = frame_dim.getSize().getWidth(), bin_height = frame_dim.getSize().getHeight();
+        if ((bin_width != width / bin) || (bin_height != height / bin)) {
+          std::cerr << render_names[render_mode] << ": bin=" << bin << " frame size " << frame_dim.getSize()
+                    << std::endl;
+          nb_errors++;
+          continue;
+        }
+
+        std::vector<float> bin_pixels(bin_width * bin_height);
+        binned.getFrame(0, (unsigned char *)bin_pixels.data());
+
+        double max_diff = 0;
+        for (int by = 0; by < bin_height; by++)
+          for (int bx = 0; bx < bin_width; bx++) {
+            double sum = 0;
+            for (int y = by * bin; y < (by + 1) * bin; y++)
+              for (int x = bx * bin; x < (bx + 1) * bin; x++)
+                sum += pixels[y * width + x];
+            max_diff = std::max(max_diff, std::fabs(sum - bin_pixels[by * bin_width + bx]));
+          }
+
+        if (max_diff > 1) {
+          std::cerr << render_names[render_mode] << ": bin=" << bin << " max. diff=" << max_diff << std::endl;
+          nb_errors++;
+        }
+      }
+    }
+
+    // Sampled binning only supports 1 and 2
+    for (int bin = 1; bin <= 4; bin++) {
+      const bool sampled = (bin <= 2);
+      if ((isBinAccepted(FrameBuilder::Sampled, bin) != sampled) || !isBinAccepted(FrameBuilder::Integrated, bin)) {
+        std::cerr << "bin=" << bin << " wrongly accepted or rejected" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // The current bin must be supported by the new mode
+    FrameBuilder fb;
+    fb.setBinningMode(FrameBuilder::Integrated);
+    fb.setBin(Bin(3, 3));
+    try {
+      fb.setBinningMode(FrameBuilder::Sampled);
+      std::cerr << "Sampled mode accepted with bin=3" << std::endl;
+      nb_errors++;
+    } catch (Exception &) {
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
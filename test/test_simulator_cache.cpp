@@ -0,0 +1,102 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the frame cache: with a rotation speed dividing 360 degrees the frames
+// of the second rotation must be copied from the cache and equal to the frames
+// generated without cache. The frames that cannot repeat must not be cached.
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int width = 256, height = 200;
+// Frames per rotation
+static const int period = 12;
+
+static void configure(FrameBuilder &fb, int cache_size, double grow_factor)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.3, 80.7, 12.5, 1000));
+  peaks.push_back(GaussPeak(200.6, 150.2, 3.1, 20000));
+
+  fb.setFrameDim(FrameDim(width, height, Bpp16));
+  fb.setPeaks(peaks);
+  fb.setGrowFactor(grow_factor);
+  fb.setRotationSpeed(360.0 / period);
+  fb.setFrameCacheSize(cache_size);
+  fb.prepareAcq();
+}
+
+static bool checkStats(FrameBuilder &fb, const char *name, unsigned long hits, unsigned long misses)
+{
+  unsigned long nb_hits, nb_misses;
+  fb.getFrameCacheHits(nb_hits);
+  fb.getFrameCacheMisses(nb_misses);
+  if ((nb_hits == hits) && (nb_misses == misses))
+    return true;
+  std::cerr << name << ": " << nb_hits << " hits, " << nb_misses << " misses, expected " << hits << " and " << misses
+            << std::endl;
+  return false;
+}
+
+int main(int argc, char *argv[])
+{
+  int nb_errors = 0;
+
+  try {
+    FrameBuilder cached, uncached;
+    configure(cached, 4, 0);
+    configure(uncached, 0, 0);
+
+    std::vector<unsigned short> frame(width * height), ref(width * height);
+    for (unsigned long frame_nr = 0; frame_nr < 2 * period; frame_nr++) {
+      cached.getFrame(frame_nr, (unsigned char *)frame.data());
+      uncached.getFrame(frame_nr, (unsigned char *)ref.data());
+      if (memcmp(frame.data(), ref.data(), frame.size() * sizeof(unsigned short))) {
+        std::cerr << "Frame " << frame_nr << " differs from the generated one" << std::endl;
+        nb_errors++;
+      }
+      if (frame_nr == period - 1)
+        nb_errors += !checkStats(cached, "First rotation", 0, period);
+    }
+    nb_errors += !checkStats(cached, "Second rotation", period, period);
+
+    // Every frame is different with a grow factor
+    FrameBuilder growing;
+    configure(growing, 4, 0.01);
+    for (unsigned long frame_nr = 0; frame_nr < 2 * period; frame_nr++)
+      growing.getFrame(frame_nr, (unsigned char *)frame.data());
+    nb_errors += !checkStats(growing, "Grow factor", 0, 0);
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
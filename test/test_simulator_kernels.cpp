@@ -0,0 +1,172 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Compares the frames generated with the vectorized kernels against the
+// Scalar ones, for each fill type, image type and binning: they must not
+// differ by more than 1 LSB. The packing kernels must give the same bytes.
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "simulator/SimulatorFrameKernels.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+template <class depth>
+static double maxDiff(FrameBuilder &ref, FrameBuilder &simd, unsigned long frame_nr, int nb_pixels)
+{
+  std::vector<depth> ref_buffer(nb_pixels), simd_buffer(nb_pixels);
+  ref.getFrame(frame_nr, (unsigned char *)ref_buffer.data());
+  simd.getFrame(frame_nr, (unsigned char *)simd_buffer.data());
+
+  double max_diff = 0.0;
+  for (int i = 0; i < nb_pixels; i++)
+    max_diff = std::max(max_diff, std::fabs(double(ref_buffer[i]) - double(simd_buffer[i])));
+  return max_diff;
+}
+
+template <class T>
+static bool samePacking(void (*ref)(const T *, unsigned char *, int), void (*simd)(const T *, unsigned char *, int))
+{
+  // Random pixels beyond the packed bits, for several tails
+  std::vector<T> pixels(1027);
+  for (T &pixel : pixels)
+    pixel = T(rand());
+
+  for (int n = 1019; n <= 1027; n++) {
+    std::vector<unsigned char> ref_buffer(n * sizeof(T)), simd_buffer(n * sizeof(T));
+    ref(pixels.data(), ref_buffer.data(), n);
+    simd(pixels.data(), simd_buffer.data(), n);
+    if (ref_buffer != simd_buffer)
+      return false;
+  }
+  return true;
+}
+
+static void configure(FrameBuilder &fb, ImageType image_type, FrameBuilder::FillType fill_type, int bin)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100, 100, 30, 200));
+  peaks.push_back(GaussPeak(300, 200, 60, 50000));
+  peaks.push_back(GaussPeak(450, 50, 10, 1e6));
+
+  fb.setFrameDim(FrameDim(512, 384, image_type));
+  fb.setBin(Bin(bin, bin));
+  fb.setPeaks(peaks);
+  fb.setFillType(fill_type);
+  fb.setRotationSpeed(7);
+  fb.setGrowFactor(0.1);
+  fb.setDiffractionPos(250, 150);
+  fb.setDiffractionSpeed(3, 1);
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *isa_names[] = {"Scalar", "SSE4", "AVX2", "AVX512"};
+  int nb_errors                  = 0;
+
+  try {
+    FrameKernels::InstructionSet cpu_isa = FrameKernels::getCpuInstructionSet();
+    std::cout << "CPU instruction set: " << isa_names[cpu_isa] << std::endl;
+
+    ImageType image_types[] = {Bpp8,   Bpp8S, Bpp12,  Bpp12S, Bpp16, Bpp16S, Bpp24,
+                               Bpp24S, Bpp32, Bpp32S, Bpp32F, Bpp64, Bpp64S};
+    FrameBuilder::FillType fill_types[] = {FrameBuilder::Gauss, FrameBuilder::Diffraction};
+
+    for (int isa = FrameKernels::SSE4; isa <= cpu_isa; isa++)
+      for (FrameBuilder::FillType fill_type : fill_types)
+        for (ImageType image_type : image_types)
+          for (int bin = 1; bin <= 2; bin++) {
+            FrameBuilder ref, simd;
+            configure(ref, image_type, fill_type, bin);
+            configure(simd, image_type, fill_type, bin);
+            ref.setInstructionSet(FrameKernels::Scalar);
+            simd.setInstructionSet(FrameKernels::InstructionSet(isa));
+
+            FrameDim frame_dim;
+            ref.getEffectiveFrameDim(frame_dim);
+            int nb_pixels = Point(frame_dim.getSize()).getArea();
+
+            for (unsigned long frame_nr = 0; frame_nr < 3; frame_nr++) {
+              double diff;
+              switch (image_type) {
+              case Bpp8:
+                diff = maxDiff<unsigned char>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp8S:
+                diff = maxDiff<signed char>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp12:
+              case Bpp16:
+                diff = maxDiff<unsigned short>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp12S:
+              case Bpp16S:
+                diff = maxDiff<short>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp24S:
+              case Bpp32S:
+                diff = maxDiff<int>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp32F:
+                diff = maxDiff<float>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp64:
+                diff = maxDiff<unsigned long long>(ref, simd, frame_nr, nb_pixels);
+                break;
+              case Bpp64S:
+                diff = maxDiff<long long>(ref, simd, frame_nr, nb_pixels);
+                break;
+              default:
+                diff = maxDiff<unsigned int>(ref, simd, frame_nr, nb_pixels);
+              }
+
+              if (diff > 1) {
+                std::cerr << isa_names[isa] << ": fill_type=" << fill_type << " image_type=" << image_type
+                          << " bin=" << bin << " frame=" << frame_nr << " max. diff=" << diff << std::endl;
+                nb_errors++;
+              }
+            }
+          }
+
+    const FrameKernels &ref = FrameKernels::get(FrameKernels::Scalar);
+    for (int isa = FrameKernels::SSE4; isa <= cpu_isa; isa++) {
+      const FrameKernels &simd = FrameKernels::get(FrameKernels::InstructionSet(isa));
+      if (!samePacking(ref.pack_10, simd.pack_10) || !samePacking(ref.pack_12, simd.pack_12) ||
+          !samePacking(ref.pack_14, simd.pack_14) || !samePacking(ref.pack_24, simd.pack_24)) {
+        std::cerr << isa_names[isa] << ": packing differs" << std::endl;
+        nb_errors++;
+      }
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
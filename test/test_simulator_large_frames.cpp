@@ -0,0 +1,176 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+
+// Generates, prefetches and loads a frame larger than 2 GiB, checking that the
+// three paths give the same frame. Needs about 4.5 GiB of free memory and
+// 2 GiB of free disk space in the temporary directory, skipped otherwise.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#if defined(__unix)
+#include <unistd.h>
+#endif
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "simulator/SimulatorFrameLoader.h"
+#include "simulator/SimulatorFramePrefetcher.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int SKIPPED = 77;
+
+// 32768 x 16400 x 4 bytes = 2.0 GiB + 2 MiB
+static const FrameDim frame_dim(32768, 16400, Bpp32);
+
+static void configure(FrameBuilder &fb)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(1000, 1000, 40, 1000));
+  // Beyond the first 2 GiB of the frame
+  peaks.push_back(GaussPeak(32000, 16300, 50, 60000));
+
+  fb.setFrameDim(frame_dim);
+  fb.setPeaks(peaks);
+}
+
+static uint64_t checksum(const unsigned char *ptr, size_t mem_size)
+{
+  const uint64_t *words = (const uint64_t *)ptr;
+  uint64_t hash         = 14695981039346656037ULL;
+  for (size_t i = 0; i < mem_size / sizeof(uint64_t); i++)
+    hash = (hash ^ words[i]) * 1099511628211ULL;
+  return hash;
+}
+
+static size_t getAvailableMemory()
+{
+#if defined(__unix) && defined(_SC_AVPHYS_PAGES)
+  return size_t(sysconf(_SC_AVPHYS_PAGES)) * size_t(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+static void writeEDF(const std::string &file_name, const unsigned char *ptr, size_t mem_size)
+{
+  std::ostringstream header;
+  header << "{\n"
+         << "HeaderID = EH:000001:000000:000000 ;\n"
+         << "Image = 1 ;\n"
+         << "ByteOrder = LowByteFirst ;\n"
+         << "DataType = UnsignedInteger ;\n"
+         << "Dim_1 = " << frame_dim.getSize().getWidth() << " ;\n"
+         << "Dim_2 = " << frame_dim.getSize().getHeight() << " ;\n"
+         << "Size = " << mem_size << " ;\n";
+
+  std::string block = header.str();
+  block.resize(510, ' ');
+  block += "}\n";
+
+  std::ofstream file(file_name.c_str(), std::ios::binary);
+  file.write(block.data(), block.size());
+  file.write((const char *)ptr, std::streamsize(mem_size));
+  if (!file)
+    throw LIMA_HW_EXC(Error, "Failed to write EDF file");
+}
+
+int main(int argc, char *argv[])
+{
+  size_t mem_size = getFrameMemSize(frame_dim);
+  std::filesystem::path dir = std::filesystem::temp_directory_path();
+
+  // The frame buffer and the prefetched one
+  size_t needed_memory = 2 * mem_size + (256 << 20);
+  if (getAvailableMemory() < needed_memory) {
+    std::cout << "SKIPPED: needs " << (needed_memory >> 20) << " MiB of free memory" << std::endl;
+    return SKIPPED;
+  }
+  if (std::filesystem::space(dir).available < mem_size + (64 << 20)) {
+    std::cout << "SKIPPED: needs " << (mem_size >> 20) << " MiB of free disk space in " << dir << std::endl;
+    return SKIPPED;
+  }
+
+  std::string file_name = (dir / "test_simulator_large_frame_000.edf").string();
+  int nb_errors         = 0;
+
+  try {
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[mem_size]);
+
+    FrameBuilder fb;
+    configure(fb);
+    fb.prepareAcq();
+    fb.getFrame(0, buffer.get());
+    uint64_t ref = checksum(buffer.get(), mem_size);
+
+    // The second peak center
+    const unsigned int *pixels = (const unsigned int *)buffer.get();
+    if (pixels[size_t(16300) * 32768 + 32000] == 0) {
+      std::cerr << "Generator: nothing beyond 2 GiB" << std::endl;
+      nb_errors++;
+    }
+
+    {
+      FramePrefetcher<FrameBuilder> prefetcher;
+      configure(prefetcher);
+      prefetcher.setNbPrefetchedFrames(1);
+      prefetcher.prepareAcq();
+
+      memset(buffer.get(), 0, mem_size);
+      prefetcher.getFrame(0, buffer.get());
+      if (checksum(buffer.get(), mem_size) != ref) {
+        std::cerr << "Prefetcher: frame differs" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    writeEDF(file_name, buffer.get(), mem_size);
+
+    FrameLoader loader;
+    loader.setFilePattern(file_name);
+    loader.prepareAcq();
+
+    memset(buffer.get(), 0, mem_size);
+    loader.getFrame(0, buffer.get());
+    if (checksum(buffer.get(), mem_size) != ref) {
+      std::cerr << "Loader: frame differs" << std::endl;
+      nb_errors++;
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    nb_errors++;
+  }
+
+  std::remove(file_name.c_str());
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
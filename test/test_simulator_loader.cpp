@@ -0,0 +1,541 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the FrameLoader: multi-frame EDF files with headers of several
+// blocks and frames not aligned on the blocks must give the same frames in
+// the Streamed, Mapped and Direct read modes. The persisted index must be
+// loaded by the next setFilePattern() and rebuilt once a file is touched or
+// truncated. The frames read ahead must be the same, in or out of sequence,
+// and the errors of the reader thread must reach getFrame(). The frames of
+// contiguous, chunked and compressed HDF5 datasets, of NumPy arrays and of
+// raw files must be read likewise, their headers and sizes being checked.
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(SIMULATOR_WITH_HDF5)
+#include <hdf5.h>
+#endif
+
+#include "simulator/SimulatorFrameLoader.h"
+#include "simulator/SimulatorFramePrefetcher.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+typedef std::vector<std::vector<unsigned char>> Frames;
+
+// Odd frame size, the data sections are not aligned
+static const int width = 61, height = 37;
+
+static std::vector<unsigned short> framePixels(int frame_nr)
+{
+  std::vector<unsigned short> pixels(width * height);
+  for (size_t i = 0; i < pixels.size(); i++)
+    pixels[i] = (unsigned short)(i * 7 + frame_nr * 1013);
+  return pixels;
+}
+
+static std::vector<unsigned char> frameBytes(int frame_nr)
+{
+  std::vector<unsigned short> pixels = framePixels(frame_nr);
+  const unsigned char *ptr           = (const unsigned char *)pixels.data();
+  return std::vector<unsigned char>(ptr, ptr + pixels.size() * sizeof(unsigned short));
+}
+
+// Writes the frames [first_frame, first_frame + nb_frames), the headers
+// taking nb_blocks blocks of 512 bytes
+static void writeEDF(const std::filesystem::path &file_name, int first_frame, int nb_frames, int nb_blocks)
+{
+  std::ofstream file(file_name, std::ios::binary);
+  for (int frame_nr = first_frame; frame_nr < first_frame + nb_frames; frame_nr++) {
+    std::ostringstream header;
+    header << "{\n"
+           << "HeaderID = EH:000001:000000:000000 ;\n"
+           << "Image = " << frame_nr + 1 << " ;\n"
+           << "ByteOrder = LowByteFirst ;\n"
+           << "DataType = UnsignedShort ;\n"
+           << "Dim_1 = " << width << " ;\n"
+           << "Dim_2 = " << height << " ;\n"
+           << "Size = " << width * height * 2 << " ;\n"
+           << "Comment = " << std::string(512 * (nb_blocks - 1), '-') << " ;\n";
+
+    std::string block = header.str();
+    block.resize(512 * nb_blocks - 2, ' ');
+    block += "}\n";
+
+    std::vector<unsigned char> data = frameBytes(frame_nr);
+    file.write(block.data(), block.size());
+    file.write((const char *)data.data(), data.size());
+  }
+  if (!file)
+    throw LIMA_HW_EXC(Error, "Failed to write EDF file");
+}
+
+// Writes a NumPy file: the header holds the repr() of the dict, padded to a
+// multiple of 64 bytes, followed by data_size bytes of the frames from first_frame
+static void writeNpy(const std::filesystem::path &file_name, const std::string &dict, int version, int first_frame,
+                     size_t data_size)
+{
+  const size_t dict_offset = (version == 1) ? 10 : 12;
+  std::string header       = dict;
+  header.resize((dict_offset + dict.size() + 1 + 63) / 64 * 64 - dict_offset - 1, ' ');
+  header += '\n';
+
+  std::string prefix = "\x93NUMPY";
+  prefix += char(version);
+  prefix += char(0);
+  for (size_t i = 0; i < dict_offset - 8; i++)
+    prefix += char((header.size() >> (8 * i)) & 0xff);
+
+  std::vector<unsigned char> data;
+  for (int frame_nr = first_frame; data.size() < data_size; frame_nr++) {
+    std::vector<unsigned char> frame = frameBytes(frame_nr);
+    data.insert(data.end(), frame.begin(), frame.end());
+  }
+
+  std::ofstream file(file_name, std::ios::binary);
+  file << prefix << header;
+  file.write((const char *)data.data(), data_size);
+}
+
+// Writes a raw file of data_size bytes of the frames from first_frame
+static void writeRaw(const std::filesystem::path &file_name, int first_frame, size_t data_size)
+{
+  std::vector<unsigned char> data;
+  for (int frame_nr = first_frame; data.size() < data_size; frame_nr++) {
+    std::vector<unsigned char> frame = frameBytes(frame_nr);
+    data.insert(data.end(), frame.begin(), frame.end());
+  }
+
+  std::ofstream file(file_name, std::ios::binary);
+  file.write((const char *)data.data(), data_size);
+}
+
+// Returns the error of setFilePattern(), empty if none
+static std::string getPatternError(FrameLoader &loader, const std::filesystem::path &file_name)
+{
+  try {
+    loader.setFilePattern(file_name.string());
+  } catch (Exception &e) {
+    return e.getErrMsg();
+  }
+  return std::string();
+}
+
+// Parses NumPy headers, valid or not
+static int checkNpyHeaders(const std::filesystem::path &dir)
+{
+  struct NpyCase {
+    const char *dict;
+    size_t data_size;
+    FrameDim frame_dim; //<! Of the valid headers
+    const char *error;  //<! Beginning of the error of the invalid ones
+  };
+  static const size_t frame_size = width * height;
+  static const NpyCase cases[]   = {
+    {"{'descr': '<u2', 'fortran_order': False, 'shape': (61, 37), }", frame_size * 2, FrameDim(37, 61, Bpp16), ""},
+    {"{'descr': '|u1', 'fortran_order': False, 'shape': (2, 37, 61), }", frame_size * 2, FrameDim(61, 37, Bpp8), ""},
+    {"{'shape': (37, 61), 'fortran_order': False, 'descr': '<i4'}", frame_size * 4, FrameDim(61, 37, Bpp32S), ""},
+    {"{'descr': '<f4', 'fortran_order': False, 'shape': (1, 37, 61)}", frame_size * 4, FrameDim(61, 37, Bpp32F), ""},
+    {"{'descr': '<u2', 'fortran_order': True, 'shape': (37, 61), }", frame_size * 2, FrameDim(), "Fortran order"},
+    {"{'descr': '>u2', 'fortran_order': False, 'shape': (37, 61), }", frame_size * 2, FrameDim(), "Unsupported pixel"},
+    {"{'descr': '<f8', 'fortran_order': False, 'shape': (37, 61), }", frame_size * 8, FrameDim(), "Unsupported pixel"},
+    {"{'descr': '<u2', 'fortran_order': False, 'shape': (2257,), }", frame_size * 2, FrameDim(), "Unsupported shape"},
+    {"{'descr': '<u2', 'fortran_order': False, 'shape': (3, 37, 61), }", frame_size * 4, FrameDim(), "Truncated data"},
+    {"{'descr': '<u2', 'fortran_order': False, }", frame_size * 2, FrameDim(), "Missing shape"},
+  };
+
+  int nb_errors = 0;
+  for (const NpyCase &npy_case : cases) {
+    std::filesystem::path file_name = dir / "header.npy";
+    writeNpy(file_name, npy_case.dict, 1, 0, npy_case.data_size);
+
+    FrameLoader loader;
+    std::string error = getPatternError(loader, file_name);
+    FrameDim frame_dim;
+    if (error.empty())
+      loader.getFrameDim(frame_dim);
+    if ((error.compare(0, strlen(npy_case.error), npy_case.error) != 0) || (error.empty() != !*npy_case.error) ||
+        (error.empty() && (frame_dim != npy_case.frame_dim))) {
+      std::cerr << npy_case.dict << ": " << (error.empty() ? "no error" : error) << std::endl;
+      nb_errors++;
+    }
+  }
+  std::filesystem::remove(dir / "header.npy");
+  return nb_errors;
+}
+
+#if defined(SIMULATOR_WITH_HDF5)
+/// The storage layouts of the HDF5 datasets
+enum Hdf5Layout {
+  Contiguous,
+  Chunked,    //<! A chunk per frame
+  Compressed, //<! A chunk per frame, deflated
+};
+
+// Writes the frames [first_frame, first_frame + nb_frames) in the dataset
+// /entry_0000/measurement/data
+static void writeHdf5(const std::filesystem::path &file_name, Hdf5Layout layout, int first_frame, int nb_frames)
+{
+  std::vector<unsigned short> pixels;
+  for (int frame_nr = first_frame; frame_nr < first_frame + nb_frames; frame_nr++) {
+    std::vector<unsigned short> frame = framePixels(frame_nr);
+    pixels.insert(pixels.end(), frame.begin(), frame.end());
+  }
+
+  hsize_t dims[3]  = {hsize_t(nb_frames), hsize_t(height), hsize_t(width)};
+  hsize_t chunk[3] = {1, hsize_t(height), hsize_t(width)};
+  hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+  if (layout != Contiguous)
+    H5Pset_chunk(properties, 3, chunk);
+  if (layout == Compressed)
+    H5Pset_deflate(properties, 4);
+
+  hid_t links = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(links, 1);
+
+  hid_t file    = H5Fcreate(file_name.string().c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  hid_t space   = H5Screate_simple(3, dims, NULL);
+  hid_t dataset = H5Dcreate2(file, "/entry_0000/measurement/data", H5T_STD_U16LE, space, links, properties,
+                             H5P_DEFAULT);
+  herr_t res    = (dataset < 0) ? -1 : H5Dwrite(dataset, H5T_NATIVE_USHORT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                                                pixels.data());
+  if (dataset >= 0)
+    H5Dclose(dataset);
+  H5Sclose(space);
+  H5Fclose(file);
+  H5Pclose(links);
+  H5Pclose(properties);
+  if (res < 0)
+    throw LIMA_HW_EXC(Error, "Failed to write HDF5 file");
+}
+#endif // SIMULATOR_WITH_HDF5
+
+static Frames loadFrames(FrameLoader &loader)
+{
+  FrameDim frame_dim;
+  unsigned long nb_frames;
+  loader.getFrameDim(frame_dim);
+  loader.getNbFrames(nb_frames);
+  loader.prepareAcq();
+
+  Frames frames(nb_frames, std::vector<unsigned char>(frame_dim.getMemSize()));
+  for (unsigned long frame_nr = 0; frame_nr < nb_frames; frame_nr++)
+    loader.getFrame(frame_nr, frames[frame_nr].data());
+  return frames;
+}
+
+static Frames loadFrames(const std::string &file_pattern, FrameLoader::ReadMode read_mode)
+{
+  FrameLoader loader;
+  loader.setReadMode(read_mode);
+  loader.setFilePattern(file_pattern);
+  return loadFrames(loader);
+}
+
+// Reads the frames ahead, in and out of sequence
+static int checkReadAhead(const std::string &file_pattern, FrameLoader::ReadMode read_mode, const Frames &expected)
+{
+  static const unsigned int depth = 3;
+
+  FrameLoader loader;
+  loader.setReadMode(read_mode);
+  loader.setReadAheadDepth(depth);
+  loader.setFilePattern(file_pattern);
+  loader.prepareAcq();
+
+  // Once the ring is full, the first frames do not wait
+  unsigned int level = 0;
+  for (int i = 0; (i < 500) && (level < depth); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    loader.getReadAheadLevel(level);
+  }
+
+  int nb_errors = 0;
+  std::vector<unsigned char> frame(expected[0].size());
+  unsigned long nb_stalls;
+  for (unsigned long frame_nr = 0; frame_nr < depth; frame_nr++) {
+    loader.getFrame(frame_nr, frame.data());
+    nb_errors += (frame != expected[frame_nr]);
+  }
+  loader.getReadAheadStalls(nb_stalls);
+  if ((level != depth) || nb_stalls) {
+    std::cerr << "Read ahead: level=" << level << ", " << nb_stalls << " stalls in sequence" << std::endl;
+    nb_errors++;
+  }
+
+  // A frame out of sequence restarts the reader, which is waited for
+  for (unsigned long frame_nr : {6, 7, 1, 2, 3, 0}) {
+    loader.getFrame(frame_nr, frame.data());
+    nb_errors += (frame != expected[frame_nr]);
+  }
+  loader.getReadAheadStalls(nb_stalls);
+  if (nb_stalls < 3) {
+    std::cerr << "Read ahead: " << nb_stalls << " stalls out of sequence" << std::endl;
+    nb_errors++;
+  }
+
+  double rate;
+  loader.getReadAheadRate(rate);
+  if (rate <= 0) {
+    std::cerr << "Read ahead: rate=" << rate << std::endl;
+    nb_errors++;
+  }
+  return nb_errors;
+}
+
+// Swaps the first two frames of an index file
+static void swapIndexFrames(const std::filesystem::path &index_file)
+{
+  std::vector<std::string> lines;
+  std::string line;
+  std::ifstream input_file(index_file);
+  while (std::getline(input_file, line))
+    lines.push_back(line);
+  input_file.close();
+
+  // Magic, files, frame dimensions and count, then a frame per line
+  size_t first_frame = 2 + std::stoul(lines[1]) + 1;
+  std::swap(lines[first_frame], lines[first_frame + 1]);
+
+  std::ofstream output_file(index_file);
+  for (const std::string &l : lines)
+    output_file << l << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *mode_names[] = {"Streamed", "Mapped", "Direct"};
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "test_simulator_loader";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  int nb_errors = 0;
+
+  try {
+    writeEDF(dir / "frames_0.edf", 0, 4, 1);
+    writeEDF(dir / "frames_1.edf", 4, 3, 3);
+    writeEDF(dir / "frames_2.edf", 7, 1, 2);
+    const std::string file_pattern = (dir / "frames_*.edf").string();
+
+    Frames expected;
+    for (int frame_nr = 0; frame_nr < 8; frame_nr++)
+      expected.push_back(frameBytes(frame_nr));
+
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++) {
+      if (loadFrames(file_pattern, FrameLoader::ReadMode(read_mode)) != expected) {
+        std::cerr << mode_names[read_mode] << ": frames differ" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++) {
+      int nb_bad = checkReadAhead(file_pattern, FrameLoader::ReadMode(read_mode), expected);
+      if (nb_bad) {
+        std::cerr << mode_names[read_mode] << ": " << nb_bad << " errors reading ahead" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // A file truncated after the indexing fails in the reader thread
+    {
+      FrameLoader loader;
+      loader.setReadAheadDepth(2);
+      loader.setFilePattern(file_pattern);
+      std::filesystem::resize_file(dir / "frames_2.edf", 1024);
+      loader.prepareAcq();
+
+      std::vector<unsigned char> frame(expected[0].size());
+      for (unsigned long frame_nr = 0; frame_nr < 7; frame_nr++)
+        loader.getFrame(frame_nr, frame.data());
+      try {
+        loader.getFrame(7, frame.data());
+        std::cerr << "Read ahead: truncated frame read" << std::endl;
+        nb_errors++;
+      } catch (Exception &e) {
+        if (e.getErrMsg().find("Failed to read frame 7 of ") == std::string::npos) {
+          std::cerr << "Read ahead: " << e << std::endl;
+          nb_errors++;
+        }
+      }
+
+      // Until another frame is requested
+      loader.getFrame(4, frame.data());
+      if (frame != expected[4]) {
+        std::cerr << "Read ahead: no recovery from an error" << std::endl;
+        nb_errors++;
+      }
+      writeEDF(dir / "frames_2.edf", 7, 1, 2);
+    }
+
+    // The prefetched frames are read in any order
+    FramePrefetcher<FrameLoader> prefetcher;
+    try {
+      prefetcher.setReadAheadDepth(4);
+      std::cerr << "Read ahead accepted with prefetched frames" << std::endl;
+      nb_errors++;
+    } catch (Exception &) {
+    }
+    prefetcher.setFilePattern(file_pattern);
+    prefetcher.setNbPrefetchedFrames(8);
+    prefetcher.prepareAcq();
+    std::vector<unsigned char> frame(expected[0].size());
+    for (unsigned long frame_nr = 0; frame_nr < 8; frame_nr++) {
+      prefetcher.getFrame(frame_nr, frame.data());
+      if (frame != expected[frame_nr]) {
+        std::cerr << "Prefetched frame " << frame_nr << " differs" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // The Size header of an EDF frame must match its dimensions
+    {
+      FrameLoader loader;
+      std::filesystem::path file_name = dir / "bad_size.edf";
+      writeEDF(file_name, 0, 2, 1);
+      const std::streamoff header_offset = 512 + width * height * 2;
+      std::fstream file(file_name, std::ios::in | std::ios::out | std::ios::binary);
+      std::string header(512, '\0');
+      file.seekg(header_offset);
+      file.read(&header[0], header.size());
+      file.seekp(header_offset + header.find("Size = ") + 7);
+      file << width * height * 2 + 2;
+      file.close();
+      if (getPatternError(loader, file_name).find("Size of frame 1 of EDF file") == std::string::npos) {
+        std::cerr << "EDF frame of a wrong size accepted" << std::endl;
+        nb_errors++;
+      }
+      std::filesystem::remove(file_name);
+    }
+
+#if defined(SIMULATOR_WITH_HDF5)
+    writeHdf5(dir / "frames_0.h5", Contiguous, 0, 4);
+    writeHdf5(dir / "frames_1.h5", Chunked, 4, 3);
+    writeHdf5(dir / "frames_2.h5", Compressed, 7, 1);
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++) {
+      // In the default dataset, as written by LImA
+      if (loadFrames((dir / "frames_*.h5").string(), FrameLoader::ReadMode(read_mode)) != expected) {
+        std::cerr << mode_names[read_mode] << ": HDF5 frames differ" << std::endl;
+        nb_errors++;
+      }
+    }
+#endif // SIMULATOR_WITH_HDF5
+
+    // NumPy arrays of several frames, or of one, version 1 and 2 headers
+    const size_t frame_size = width * height * 2;
+    writeNpy(dir / "frames_0.npy", "{'descr': '<u2', 'fortran_order': False, 'shape': (4, 37, 61), }", 1, 0,
+             4 * frame_size);
+    writeNpy(dir / "frames_1.npy", "{'descr': '<u2', 'fortran_order': False, 'shape': (37, 61), }", 2, 4, frame_size);
+    writeNpy(dir / "frames_2.npy", "{'descr': '<u2', 'fortran_order': False, 'shape': (3, 37, 61), }", 1, 5,
+             3 * frame_size);
+    nb_errors += checkNpyHeaders(dir);
+
+    // Raw files, of the frame dimensions set
+    writeRaw(dir / "frames_0.raw", 0, 5 * frame_size);
+    writeRaw(dir / "frames_1.raw", 5, 3 * frame_size);
+
+    for (int read_mode = FrameLoader::Streamed; read_mode <= FrameLoader::Direct; read_mode++) {
+      if (loadFrames((dir / "frames_*.npy").string(), FrameLoader::ReadMode(read_mode)) != expected) {
+        std::cerr << mode_names[read_mode] << ": NumPy frames differ" << std::endl;
+        nb_errors++;
+      }
+
+      FrameLoader loader;
+      loader.setReadMode(FrameLoader::ReadMode(read_mode));
+      loader.setRawFrameDim(FrameDim(width, height, Bpp16));
+      loader.setFilePattern((dir / "frames_*.raw").string());
+      if (loadFrames(loader) != expected) {
+        std::cerr << mode_names[read_mode] << ": raw frames differ" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // A raw file must hold whole frames
+    {
+      FrameLoader loader;
+      std::filesystem::path file_name = dir / "partial.raw";
+      writeRaw(file_name, 0, 2 * frame_size + 5);
+      loader.setRawFrameDim(FrameDim(width, height, Bpp16));
+      if (getPatternError(loader, file_name).find("not a multiple of the frame size") == std::string::npos) {
+        std::cerr << "Partial raw frame accepted" << std::endl;
+        nb_errors++;
+      }
+      std::filesystem::remove(file_name);
+    }
+
+    // The index is saved by the first setFilePattern(), loaded by the next one
+    FrameLoader loader;
+    std::filesystem::path index_file = dir / "frames.idx";
+    loader.setIndexFile(index_file.string());
+    loader.setFilePattern(file_pattern);
+    if (!std::filesystem::exists(index_file) || (loadFrames(loader) != expected)) {
+      std::cerr << "Index not saved" << std::endl;
+      nb_errors++;
+    }
+
+    swapIndexFrames(index_file);
+    loader.setFilePattern(file_pattern);
+    Frames frames = loadFrames(loader);
+    if ((frames.size() != expected.size()) || (frames[0] != expected[1]) || (frames[1] != expected[0])) {
+      std::cerr << "Index not loaded" << std::endl;
+      nb_errors++;
+    }
+
+    // A touched file invalidates the index
+    swapIndexFrames(index_file);
+    std::filesystem::path file = dir / "frames_0.edf";
+    std::filesystem::last_write_time(file, std::filesystem::last_write_time(file) + std::chrono::seconds(10));
+    loader.setFilePattern(file_pattern);
+    if (loadFrames(loader) != expected) {
+      std::cerr << "Index not rebuilt after a touch" << std::endl;
+      nb_errors++;
+    }
+
+    // So does a truncated one, without its last frame
+    file = dir / "frames_1.edf";
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) - width * height * 2 - 3 * 512);
+    loader.setFilePattern(file_pattern);
+    expected.erase(expected.begin() + 6);
+    if (loadFrames(loader) != expected) {
+      std::cerr << "Index not rebuilt after a truncation" << std::endl;
+      nb_errors++;
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    nb_errors++;
+  }
+
+  std::filesystem::remove_all(dir);
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
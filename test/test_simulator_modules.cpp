@@ -0,0 +1,146 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the module layouts: the frame size must include the gaps, the gap
+// pixels must hold the gap value and each module must be the region, at its
+// offset, of the same frame rendered without modules, in both the assembled
+// and the module order.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int module_width = 96, module_height = 64, gap_width = 8, gap_height = 12;
+static const int nb_modules_x = 3, nb_modules_y = 2;
+static const int width  = nb_modules_x * module_width + (nb_modules_x - 1) * gap_width;
+static const int height = nb_modules_y * module_height + (nb_modules_y - 1) * gap_height;
+
+static void configure(FrameBuilder &fb, int bin)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.3, 60.7, 12.5, 1000));
+  peaks.push_back(GaussPeak(200.6, 110.2, 30, 4000));
+  peaks.push_back(GaussPeak(20.5, 20.5, 6, 500));
+
+  fb.setFrameDim(FrameDim(width, height, Bpp16));
+  fb.setPeaks(peaks);
+  fb.setGrowFactor(0);
+  fb.setBin(Bin(bin, bin));
+}
+
+static int checkLayout(int bin, bool module_order)
+{
+  const unsigned short gap_value = 1234;
+  int nb_errors                  = 0;
+
+  FrameBuilder flat;
+  configure(flat, bin);
+  std::vector<unsigned short> ref(width * height);
+  flat.getFrame(0, (unsigned char *)ref.data());
+
+  FrameBuilder modules;
+  configure(modules, bin);
+  modules.setModuleLayout(Size(module_width, module_height), Size(gap_width, gap_height), nb_modules_x,
+                          nb_modules_y);
+  modules.setGapValue(gap_value);
+  modules.setModuleOrder(module_order);
+
+  FrameDim frame_dim;
+  modules.getEffectiveFrameDim(frame_dim);
+  const int bin_width = width / bin, bin_height = height / bin;
+  const int mod_width = module_width / bin, mod_height = module_height / bin;
+  // The modules are stacked vertically in module order
+  Size size = module_order ? Size(mod_width, mod_height * nb_modules_x * nb_modules_y) : Size(bin_width, bin_height);
+  if (frame_dim.getSize() != size) {
+    std::cerr << "bin=" << bin << (module_order ? " module" : " assembled") << " order: frame size "
+              << frame_dim.getSize() << std::endl;
+    return 1;
+  }
+
+  std::vector<unsigned short> frame(size.getWidth() * size.getHeight());
+  modules.getFrame(0, (unsigned char *)frame.data());
+
+  const int pitch_x = mod_width + gap_width / bin, pitch_y = mod_height + gap_height / bin;
+  double max_diff = 0;
+  int nb_bad_gaps = 0;
+  for (int y = 0; y < bin_height; y++) {
+    for (int x = 0; x < bin_width; x++) {
+      const int mx = x / pitch_x, my = y / pitch_y;
+      const int px = x % pitch_x, py = y % pitch_y;
+      const bool gap = (px >= mod_width) || (py >= mod_height);
+      if (module_order && gap)
+        continue;
+
+      size_t offset;
+      if (module_order)
+        offset = size_t(my * nb_modules_x + mx) * mod_width * mod_height + size_t(py) * mod_width + px;
+      else
+        offset = size_t(y) * bin_width + x;
+
+      if (gap)
+        nb_bad_gaps += (frame[offset] != gap_value);
+      else
+        max_diff = std::max(max_diff, std::fabs(double(frame[offset]) - ref[y * bin_width + x]));
+    }
+  }
+
+  // The peaks of a module may be summed in another order than in the whole frame
+  if ((max_diff > 1) || nb_bad_gaps) {
+    std::cerr << "bin=" << bin << (module_order ? " module" : " assembled") << " order: max. diff=" << max_diff
+              << ", " << nb_bad_gaps << " bad gap pixels" << std::endl;
+    nb_errors++;
+  }
+  return nb_errors;
+}
+
+int main(int argc, char *argv[])
+{
+  int nb_errors = 0;
+
+  try {
+    for (int bin : {1, 2})
+      for (bool module_order : {false, true})
+        nb_errors += checkLayout(bin, module_order);
+
+    // The modules and gaps must be multiples of the bin
+    FrameBuilder fb;
+    fb.setBin(Bin(2, 2));
+    try {
+      fb.setModuleLayout(Size(module_width, module_height), Size(5, gap_height), nb_modules_x, nb_modules_y);
+      std::cerr << "Odd gap accepted with bin=2" << std::endl;
+      nb_errors++;
+    } catch (Exception &) {
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the noise stage: a noisy frame must not depend on the number of
+// threads generating it, the random streams must not depend on the instruction
+// set and the shot and read noise must have the configured mean and variance.
+//
+// The vectorized kernels approximate log() and cos(), the normal deviates are
+// thus compared within a relative tolerance. The Poisson deviates, being
+// integers, must be exactly the same.
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "simulator/SimulatorFrameKernels.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int nb_samples = 1 << 20;
+
+static std::vector<float> noisyFrame(int nb_threads)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.3, 80.7, 12.5, 1000));
+  peaks.push_back(GaussPeak(250.6, 150.2, 3.1, 20));
+  peaks.push_back(GaussPeak(30.5, 200.5, 40, 5));
+
+  FrameBuilder fb;
+  fb.setFrameDim(FrameDim(360, 240, Bpp32F));
+  fb.setPeaks(peaks);
+  fb.setShotNoise(true);
+  fb.setReadNoise(2.5);
+  fb.setDarkOffset(10);
+  fb.setNoiseSeed(1234);
+  fb.setNbThreads(nb_threads);
+
+  std::vector<float> pixels(360 * 240);
+  fb.getFrame(7, (unsigned char *)pixels.data());
+  return pixels;
+}
+
+// Mean and variance of noise_row() applied to a flat row
+static void noiseMoments(const FrameKernels::NoiseModel &noise, double lambda, double &mean, double &var)
+{
+  std::vector<double> row(nb_samples, lambda);
+  FrameKernels::get(FrameKernels::Scalar).noise_row(noise, 3, 0, row.data(), 1.0, row.data(), nb_samples);
+
+  double sum = 0, sum2 = 0;
+  for (double v : row) {
+    sum += v;
+    sum2 += v * v;
+  }
+  mean = sum / nb_samples;
+  var  = sum2 / nb_samples - mean * mean;
+}
+
+static int checkMoments(const char *name, const FrameKernels::NoiseModel &noise, double lambda)
+{
+  double mean, var;
+  noiseMoments(noise, lambda, mean, var);
+
+  // The normal approximation of the shot noise is rounded, adding 1/12 to its variance
+  double shot_var = noise.shot_noise ? lambda : 0.0;
+  double read_var = noise.read_noise * noise.read_noise;
+  double exp_mean = lambda + noise.dark_offset;
+  double exp_var  = shot_var + read_var + ((noise.shot_noise && (lambda >= 32)) ? 1.0 / 12 : 0.0);
+
+  // Five standard deviations of the estimators
+  double mean_tol = 5 * std::sqrt(exp_var / nb_samples);
+  double var_tol  = 5 * std::sqrt((shot_var + 2 * exp_var * exp_var) / nb_samples);
+  if ((std::fabs(mean - exp_mean) > mean_tol) || (std::fabs(var - exp_var) > var_tol)) {
+    std::cerr << name << ": lambda=" << lambda << " mean=" << mean << " (" << exp_mean << ") var=" << var << " ("
+              << exp_var << ")" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *isa_names[] = {"Scalar", "SSE4", "AVX2", "AVX512"};
+  int nb_errors                  = 0;
+
+  try {
+    // Thread count
+    std::vector<float> ref = noisyFrame(1);
+    for (int nb_threads : {2, 3, 8, 0}) {
+      std::vector<float> frame = noisyFrame(nb_threads);
+      if (memcmp(ref.data(), frame.data(), ref.size() * sizeof(float))) {
+        std::cerr << "Noisy frame differs with " << nb_threads << " threads" << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // Instruction sets, against the Scalar kernels
+    const int n = 10000;
+    std::vector<double> src(n);
+    for (int i = 0; i < n; i++)
+      src[i] = (i % 100) * 0.7; // Both the exact and the approximated Poisson deviates
+
+    FrameKernels::NoiseModel shot = {42, true, 0.0, 3.0};
+    FrameKernels::NoiseModel read = {42, true, 1.5, 3.0};
+
+    const FrameKernels &scalar = FrameKernels::get(FrameKernels::Scalar);
+    std::vector<double> ref_u(n), ref_z1(n), ref_z2(n), ref_shot(n), ref_read(n);
+    scalar.random_row(42, FrameKernels::NOISE_STREAM, 5, 1000, ref_u.data(), ref_z1.data(), ref_z2.data(), n);
+    scalar.noise_row(shot, 5, 1000, src.data(), 1.0, ref_shot.data(), n);
+    scalar.noise_row(read, 5, 1000, src.data(), 1.0, ref_read.data(), n);
+
+    FrameKernels::InstructionSet cpu_isa = FrameKernels::getCpuInstructionSet();
+    for (int isa = FrameKernels::SSE4; isa <= cpu_isa; isa++) {
+      const FrameKernels &simd = FrameKernels::get(FrameKernels::InstructionSet(isa));
+      std::vector<double> u(n), z1(n), z2(n), shot_row(n), read_row(n);
+      simd.random_row(42, FrameKernels::NOISE_STREAM, 5, 1000, u.data(), z1.data(), z2.data(), n);
+      simd.noise_row(shot, 5, 1000, src.data(), 1.0, shot_row.data(), n);
+      simd.noise_row(read, 5, 1000, src.data(), 1.0, read_row.data(), n);
+
+      double max_z_diff = 0, max_read_diff = 0;
+      for (int i = 0; i < n; i++) {
+        max_z_diff    = std::max(max_z_diff, std::fabs(z1[i] - ref_z1[i]) + std::fabs(z2[i] - ref_z2[i]));
+        max_read_diff = std::max(max_read_diff, std::fabs(read_row[i] - ref_read[i]));
+      }
+      if (memcmp(u.data(), ref_u.data(), n * sizeof(double)) || (max_z_diff > 1e-12)) {
+        std::cerr << isa_names[isa] << ": random_row differs, max. normal diff=" << max_z_diff << std::endl;
+        nb_errors++;
+      }
+      if (memcmp(shot_row.data(), ref_shot.data(), n * sizeof(double)) || (max_read_diff > 1e-12)) {
+        std::cerr << isa_names[isa] << ": noise_row differs, max. read noise diff=" << max_read_diff << std::endl;
+        nb_errors++;
+      }
+    }
+
+    // Moments, below and above the normal approximation of the shot noise
+    FrameKernels::NoiseModel shot_only = {7, true, 0.0, 0.0};
+    FrameKernels::NoiseModel read_only = {7, false, 3.0, 20.0};
+    FrameKernels::NoiseModel both      = {7, true, 3.0, 20.0};
+    for (double lambda : {0.1, 4.0, 31.0, 100.0, 5000.0}) {
+      nb_errors += checkMoments("Shot noise", shot_only, lambda);
+      nb_errors += checkMoments("Read noise", read_only, lambda);
+      nb_errors += checkMoments("Shot and read noise", both, lambda);
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the packed output of the Camera: the frames passed to fillData()
+// must unpack to the pixels of the frame buffers, which must be left as
+// generated.
+
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorCamera.h"
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int width = 132, height = 50, nb_frames = 3;
+
+// Keeps a copy of the packed frames
+class PackedCamera : public Camera {
+public:
+  std::vector<std::vector<unsigned char>> m_packed_frames;
+
+  virtual void fillData(Data &data)
+  {
+    const unsigned char *ptr = (const unsigned char *)data.data();
+    m_packed_frames[data.frameNumber].assign(ptr, ptr + data.size());
+  }
+};
+
+// Pixel i is at the bits [i * bits, (i + 1) * bits) of the stream, LSB first
+static unsigned int unpack(const std::vector<unsigned char> &packed, int bits, size_t i)
+{
+  unsigned int value = 0;
+  for (int b = 0; b < bits; b++) {
+    size_t bit = i * bits + b;
+    value |= ((packed[bit / 8] >> (bit % 8)) & 1u) << b;
+  }
+  return value;
+}
+
+template <class T>
+static int checkPacking(ImageType image_type, int bits)
+{
+  PackedCamera cam;
+  FrameDim frame_dim(width, height, image_type);
+  cam.setFrameDim(frame_dim);
+  cam.setPackedBits(bits);
+  cam.setNbFrames(nb_frames);
+  cam.setExpTime(0);
+  cam.m_packed_frames.resize(nb_frames);
+
+  HwBufferCtrlObj *buffer = cam.getBufferCtrlObj();
+  buffer->setFrameDim(frame_dim);
+  buffer->setNbBuffers(nb_frames);
+
+  cam.prepareAcq();
+  cam.startAcq();
+  for (int i = 0; (i < 1000) && ((cam.getNbAcquiredFrames() < nb_frames) ||
+                                 (cam.getStatus() != HwInterface::StatusType::Ready));
+       i++)
+    usleep(10000);
+  if (cam.getNbAcquiredFrames() != nb_frames) {
+    std::cerr << bits << " bits: acquisition timed out" << std::endl;
+    return 1;
+  }
+
+  // The same frames, generated again
+  FrameBuilder *builder = cam.getFrameBuilder();
+  std::vector<T> ref(width * height);
+  int nb_errors = 0;
+  for (int frame_nr = 0; frame_nr < nb_frames; frame_nr++) {
+    builder->getFrame(frame_nr, (unsigned char *)ref.data());
+    const T *pixels = (const T *)buffer->getFramePtr(frame_nr);
+    if (memcmp(pixels, ref.data(), ref.size() * sizeof(T))) {
+      std::cerr << bits << " bits: frame buffer " << frame_nr << " modified" << std::endl;
+      nb_errors++;
+    }
+
+    const std::vector<unsigned char> &packed = cam.m_packed_frames[frame_nr];
+    if (packed.size() != (ref.size() * bits + 7) / 8) {
+      std::cerr << bits << " bits: packed frame " << frame_nr << " of " << packed.size() << " bytes" << std::endl;
+      nb_errors++;
+      continue;
+    }
+    size_t nb_bad = 0;
+    for (size_t i = 0; i < ref.size(); i++)
+      nb_bad += (unpack(packed, bits, i) != ref[i]);
+    if (nb_bad) {
+      std::cerr << bits << " bits: " << nb_bad << " pixels of frame " << frame_nr << " badly packed" << std::endl;
+      nb_errors++;
+    }
+  }
+  return nb_errors;
+}
+
+int main(int argc, char *argv[])
+{
+  int nb_errors = 0;
+
+  try {
+    nb_errors += checkPacking<unsigned short>(Bpp10, 10);
+    nb_errors += checkPacking<unsigned short>(Bpp12, 12);
+    nb_errors += checkPacking<unsigned short>(Bpp14, 14);
+    nb_errors += checkPacking<unsigned int>(Bpp24, 24);
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Checks the Photons fill type: the photon events must only depend on the
+// seed and the frame number, the frames must count them, and the number of
+// photons must follow the Poisson distribution of mean the peak volumes.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int width = 400, height = 300, nb_frames = 200;
+
+static FrameBuilder::PeakList getPeaks()
+{
+  // Peak volumes below and above the normal approximation of the Poisson deviates
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.3, 80.7, 2, 1));
+  peaks.push_back(GaussPeak(250.6, 150.2, 4, 10));
+  peaks.push_back(GaussPeak(200.5, 200.5, 10, 3));
+  return peaks;
+}
+
+static void configure(FrameBuilder &fb, unsigned int seed, int nb_threads)
+{
+  fb.setFrameDim(FrameDim(width, height, Bpp16));
+  fb.setPeaks(getPeaks());
+  fb.setGrowFactor(0);
+  fb.setFillType(FrameBuilder::Photons);
+  fb.setNoiseSeed(seed);
+  fb.setNbThreads(nb_threads);
+  fb.prepareAcq();
+}
+
+static bool samePhotons(const FrameBuilder::PhotonList &a, const FrameBuilder::PhotonList &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if ((a[i].x != b[i].x) || (a[i].y != b[i].y))
+      return false;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  // Volume of the peaks, max * 2 pi sigma^2
+  static const double sgm_fwhm = 0.42466090014400952136;
+  double mean_photons          = 0;
+  for (const GaussPeak &peak : getPeaks())
+    mean_photons += peak.max * 2 * M_PI * std::pow(sgm_fwhm * peak.fwhm, 2);
+
+  int nb_errors = 0;
+
+  try {
+    FrameBuilder fb, same_seed, other_seed;
+    configure(fb, 1, 1);
+    configure(same_seed, 1, 4);
+    configure(other_seed, 2, 1);
+
+    std::vector<unsigned short> frame(width * height);
+    double sum = 0, sum2 = 0;
+    int nb_same_as_other = 0;
+    for (unsigned long frame_nr = 0; frame_nr < nb_frames; frame_nr++) {
+      FrameBuilder::PhotonList photons, same_photons, other_photons;
+      fb.getPhotonEvents(frame_nr, photons);
+      same_seed.getPhotonEvents(frame_nr, same_photons);
+      other_seed.getPhotonEvents(frame_nr, other_photons);
+      if (!samePhotons(photons, same_photons)) {
+        std::cerr << "Frame " << frame_nr << ": photons not reproducible" << std::endl;
+        nb_errors++;
+      }
+      nb_same_as_other += samePhotons(photons, other_photons);
+
+      // The frame counts the photons of each pixel
+      same_seed.getFrame(frame_nr, (unsigned char *)frame.data());
+      std::vector<unsigned short> counts(width * height);
+      for (const PhotonEvent &photon : photons)
+        counts[photon.y * width + photon.x]++;
+      if (counts != frame) {
+        std::cerr << "Frame " << frame_nr << ": frame does not count the photons" << std::endl;
+        nb_errors++;
+      }
+
+      sum += photons.size();
+      sum2 += double(photons.size()) * photons.size();
+    }
+
+    if (nb_same_as_other) {
+      std::cerr << nb_same_as_other << " frames do not depend on the seed" << std::endl;
+      nb_errors++;
+    }
+
+    // Five standard deviations of the estimators, the variance of the
+    // sample variance of a Poisson distribution being lambda + 2 lambda^2
+    double mean = sum / nb_frames;
+    double var  = (sum2 - sum * mean) / (nb_frames - 1);
+    if ((std::fabs(mean - mean_photons) > 5 * std::sqrt(mean_photons / nb_frames)) ||
+        (std::fabs(var - mean_photons) >
+         5 * std::sqrt((mean_photons + 2 * mean_photons * mean_photons) / nb_frames))) {
+      std::cerr << "Photons per frame: mean=" << mean << " var=" << var << ", expected " << mean_photons
+                << std::endl;
+      nb_errors++;
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Compares the Sprite render mode against the Reference one, for peaks at
+// sub-pixel positions, static and rotating. The interpolated profiles have an
+// error of about 5e-6 of the peak maximum for a FWHM of 2 pixels: a pixel must
+// not differ by more than 1e-5 of the peak maxima per summed sub-pixel.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "simulator/SimulatorFrameBuilder.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Simulator;
+
+static const int width = 320, height = 256;
+static const double tolerance = 1e-5;
+
+static void configure(FrameBuilder &fb, FrameBuilder::RenderMode render_mode, int bin, double rot_speed)
+{
+  FrameBuilder::PeakList peaks;
+  peaks.push_back(GaussPeak(100.37, 80.71, 2.0, 10000));
+  peaks.push_back(GaussPeak(180.61, 150.23, 3.3, 20000));
+  peaks.push_back(GaussPeak(181.13, 152.89, 2.4, 15000));
+  peaks.push_back(GaussPeak(60.5, 200.5, 17.7, 5000));
+
+  fb.setFrameDim(FrameDim(width, height, Bpp32F));
+  fb.setPeaks(peaks);
+  fb.setGrowFactor(0);
+  fb.setRotationSpeed(rot_speed);
+  fb.setRenderMode(render_mode);
+  fb.setBin(Bin(bin, bin));
+  fb.prepareAcq();
+}
+
+int main(int argc, char *argv[])
+{
+  // Sum of the peak maxima
+  static const double peaks_max = 50000;
+  int nb_errors                 = 0;
+
+  try {
+    for (int bin : {1, 2}) {
+      for (double rot_speed : {0.0, 7.3}) {
+        FrameBuilder ref, sprite;
+        configure(ref, FrameBuilder::Reference, bin, rot_speed);
+        configure(sprite, FrameBuilder::Sprite, bin, rot_speed);
+
+        const int nb_pixels = (width / bin) * (height / bin);
+        std::vector<float> ref_pixels(nb_pixels), sprite_pixels(nb_pixels);
+        double max_diff = 0;
+        for (unsigned long frame_nr = 0; frame_nr < 10; frame_nr++) {
+          ref.getFrame(frame_nr, (unsigned char *)ref_pixels.data());
+          sprite.getFrame(frame_nr, (unsigned char *)sprite_pixels.data());
+          for (int i = 0; i < nb_pixels; i++)
+            max_diff = std::max(max_diff, std::fabs(double(ref_pixels[i]) - sprite_pixels[i]));
+        }
+
+        double max_error = max_diff / (peaks_max * bin * bin);
+        std::cout << "bin=" << bin << " rotation=" << rot_speed << ": max. error=" << max_error << std::endl;
+        if (max_error > tolerance) {
+          std::cerr << "Sprite differs from Reference" << std::endl;
+          nb_errors++;
+        }
+      }
+    }
+  } catch (Exception &e) {
+    std::cerr << e << std::endl;
+    return -1;
+  }
+
+  std::cout << (nb_errors ? "FAILED" : "OK") << std::endl;
+  return nb_errors ? 1 : 0;
+}